@@ -0,0 +1,377 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <stdexcept>
+#include "EncryptorManager.h"
+#include "KeyScheduleCache.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BENCH_HAS_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC 1
+#else
+#define BENCH_HAS_TSC 0
+#endif
+
+// Time stamp counter ticks. On current x86 parts the TSC runs at the nominal
+// frequency, not the boosted core clock, so cycles/byte are comparable across
+// runs on one machine rather than across machines.
+static uint64_t readCycles() {
+#if BENCH_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchResult {
+    std::string kind;
+    std::string algorithm;
+    std::string backend;
+    std::string mode;
+    std::string padding;
+    std::string operation;
+    uint64_t bytes = 0;
+    uint64_t iterations = 0;
+    double nsPerOp = 0;
+    double megabytesPerSecond = 0;
+    double cyclesPerOp = 0;
+    double cyclesPerByte = 0;
+};
+
+template<class T>
+struct Named {
+    const char* name;
+    T value;
+};
+
+static const std::vector<Named<EncryptionAlgorithm>> ALGORITHMS = {
+    { "des", EncryptionAlgorithm::DES },
+    { "deal", EncryptionAlgorithm::DEAL },
+    { "mars", EncryptionAlgorithm::MARS },
+    { "serpent", EncryptionAlgorithm::SERPENT } };
+
+static const std::vector<Named<CipherBackend>> BACKENDS = {
+    { "reference", CipherBackend::Reference },
+    { "optimized", CipherBackend::Optimized } };
+
+static const std::vector<Named<CryptoMode>> MODES = {
+    { "ecb", CryptoMode::ECB }, { "cbc", CryptoMode::CBC }, { "pcbc", CryptoMode::PCBC },
+    { "cfb", CryptoMode::CFB }, { "ofb", CryptoMode::OFB }, { "ctr", CryptoMode::CTR },
+    { "randomdelta", CryptoMode::RandomDelta }, { "gcm", CryptoMode::GCM } };
+
+static const std::vector<Named<Pudding>> PADDINGS = {
+    { "zeros", Pudding::Zeros }, { "ansix923", Pudding::ANSIX923 },
+    { "pkcs7", Pudding::PKCS7 }, { "iso10126", Pudding::ISO10126 } };
+
+struct BenchOptions {
+    std::vector<std::string> algorithms;
+    std::vector<std::string> backends;
+    std::vector<std::string> modes;
+    std::vector<std::string> paddings;
+    uint64_t minSize = 16;
+    uint64_t maxSize = uint64_t(1) << 20;
+    double minSeconds = 0.2;
+    unsigned threads = 1;
+    bool keySetup = true;
+    bool cipher = true;
+    std::string format = "csv";
+    std::string output;
+};
+
+static const char* USAGE =
+    "usage: benchmark [options]\n"
+    "  --algorithm LIST     des,deal,mars,serpent (default all)\n"
+    "  --backend LIST       reference,optimized (default all)\n"
+    "  --mode LIST          ecb,cbc,pcbc,cfb,ofb,ctr,randomdelta,gcm (default all)\n"
+    "  --padding LIST       zeros,ansix923,pkcs7,iso10126 (default all)\n"
+    "  --min-size BYTES     smallest message, default 16\n"
+    "  --max-size BYTES     largest message, default 1048576; sizes grow x4,\n"
+    "                       1073741824 runs the full sweep (needs a few GiB)\n"
+    "  --min-time SECONDS   repeat each case at least this long, default 0.2\n"
+    "  --threads N          EncryptorManager::setParallel, default 1\n"
+    "  --only cipher|keysetup\n"
+    "  --format csv|json    default csv\n"
+    "  --output FILE        default stdout\n";
+
+static std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+template<class T>
+static std::vector<Named<T>> select(const std::vector<Named<T>>& all, const std::vector<std::string>& names,
+    const char* what) {
+    if (names.empty()) {
+        return all;
+    }
+    std::vector<Named<T>> selected;
+    for (const auto& name : names) {
+        bool found = false;
+        for (const auto& item : all) {
+            if (name == item.name) {
+                selected.push_back(item);
+                found = true;
+            }
+        }
+        if (!found) {
+            throw std::invalid_argument(std::string("unknown ") + what + ": " + name);
+        }
+    }
+    return selected;
+}
+
+static BenchOptions parseOptions(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("missing value for " + arg);
+        }
+        std::string value = argv[++i];
+        if (arg == "--algorithm") options.algorithms = splitList(value);
+        else if (arg == "--backend") options.backends = splitList(value);
+        else if (arg == "--mode") options.modes = splitList(value);
+        else if (arg == "--padding") options.paddings = splitList(value);
+        else if (arg == "--min-size") options.minSize = std::stoull(value);
+        else if (arg == "--max-size") options.maxSize = std::stoull(value);
+        else if (arg == "--min-time") options.minSeconds = std::stod(value);
+        else if (arg == "--threads") options.threads = static_cast<unsigned>(std::stoul(value));
+        else if (arg == "--format") options.format = value;
+        else if (arg == "--output") options.output = value;
+        else if (arg == "--only") {
+            options.cipher = value == "cipher";
+            options.keySetup = value == "keysetup";
+            if (!options.cipher && !options.keySetup) {
+                throw std::invalid_argument("--only takes cipher or keysetup");
+            }
+        }
+        else {
+            throw std::invalid_argument("unknown option " + arg);
+        }
+    }
+    if (options.format != "csv" && options.format != "json") {
+        throw std::invalid_argument("unknown format: " + options.format);
+    }
+    if (options.minSize == 0 || options.minSize > options.maxSize) {
+        throw std::invalid_argument("need 0 < --min-size <= --max-size");
+    }
+    return options;
+}
+
+static std::vector<uint8_t> randomBytes(size_t size, std::mt19937_64& random) {
+    std::vector<uint8_t> bytes(size);
+    for (auto& byte : bytes) {
+        byte = static_cast<uint8_t>(random());
+    }
+    return bytes;
+}
+
+static size_t keyLength(EncryptionAlgorithm algorithm) {
+    return algorithm == EncryptionAlgorithm::DES ? 8 : 16;
+}
+
+// Runs op until minSeconds have passed (at least once) and fills the timing fields.
+template<class F>
+static void measure(BenchResult& result, double minSeconds, F op) {
+    op();   // warm-up: page faults, lazily built tables
+    uint64_t iterations = 0;
+    auto start = Clock::now();
+    uint64_t startCycles = readCycles();
+    double seconds = 0;
+    do {
+        op();
+        ++iterations;
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (seconds < minSeconds);
+    uint64_t cycles = readCycles() - startCycles;
+
+    result.iterations = iterations;
+    result.nsPerOp = seconds * 1e9 / iterations;
+    result.cyclesPerOp = BENCH_HAS_TSC ? static_cast<double>(cycles) / iterations : 0.0;
+    if (result.bytes != 0) {
+        result.megabytesPerSecond = static_cast<double>(result.bytes) * iterations / (1024.0 * 1024.0) / seconds;
+        result.cyclesPerByte = result.cyclesPerOp / result.bytes;
+    }
+}
+
+// Cost of a cold start (construct the engine, expand the key) next to a
+// KeyScheduleCache hit for the same key.
+static void benchKeySetup(const BenchOptions& options, std::vector<BenchResult>& results, std::mt19937_64& random) {
+    for (const auto& algorithm : select(ALGORITHMS, options.algorithms, "algorithm")) {
+        for (const auto& backend : select(BACKENDS, options.backends, "backend")) {
+            std::vector<uint8_t> key = randomBytes(keyLength(algorithm.value), random);
+            BenchResult result;
+            result.kind = "keysetup";
+            result.algorithm = algorithm.name;
+            result.backend = backend.name;
+            result.operation = "setkey";
+            measure(result, options.minSeconds, [&] {
+                std::unique_ptr<ICrypt> cipher(makeCipher(algorithm.value, backend.value));
+                cipher->setKey(key);
+            });
+            results.push_back(result);
+            std::cerr << "keysetup " << algorithm.name << " " << backend.name << ": "
+                << result.nsPerOp << " ns\n";
+
+            KeyScheduleCache cache;
+            cache.get(algorithm.value, backend.value, key);
+            result.operation = "cache-hit";
+            measure(result, options.minSeconds, [&] { cache.get(algorithm.value, backend.value, key); });
+            results.push_back(result);
+        }
+    }
+}
+
+// minSize, 4 * minSize, ... and maxSize itself last
+static std::vector<uint64_t> messageSizes(const BenchOptions& options) {
+    std::vector<uint64_t> sizes;
+    for (uint64_t size = options.minSize; size < options.maxSize; size = size > options.maxSize / 4 ? options.maxSize : size * 4) {
+        sizes.push_back(size);
+    }
+    sizes.push_back(options.maxSize);
+    return sizes;
+}
+
+static void benchCipher(const BenchOptions& options, std::vector<BenchResult>& results, std::mt19937_64& random) {
+    for (const auto& algorithm : select(ALGORITHMS, options.algorithms, "algorithm")) {
+        std::vector<uint8_t> key = randomBytes(keyLength(algorithm.value), random);
+        std::vector<uint8_t> IV = randomBytes(keyLength(algorithm.value), random);
+        for (const auto& backend : select(BACKENDS, options.backends, "backend")) {
+            for (const auto& mode : select(MODES, options.modes, "mode")) {
+                // GCM needs a 128-bit block
+                if (mode.value == CryptoMode::GCM && algorithm.value == EncryptionAlgorithm::DES) {
+                    continue;
+                }
+                for (const auto& padding : select(PADDINGS, options.paddings, "padding")) {
+                    EncryptorManager manager(key, algorithm.value, mode.value, padding.value, IV, backend.value);
+                    manager.setParallel(options.threads);
+                    // a GCM nonce encrypts one message, every encryption needs setIV first;
+                    // reusing IV is only acceptable because nothing here is kept
+                    bool gcm = mode.value == CryptoMode::GCM;
+                    auto encrypt = [&](std::vector<uint8_t>& plaintext) {
+                        if (gcm)
+                            manager.setIV(IV);
+                        return manager.encrypt(plaintext);
+                    };
+
+                    for (uint64_t size : messageSizes(options)) {
+                        std::vector<uint8_t> plaintext = randomBytes(static_cast<size_t>(size), random);
+                        std::vector<uint8_t> ciphertext = encrypt(plaintext);
+                        std::vector<uint8_t> tag;
+                        if (gcm) {
+                            tag = manager.getTag();
+                        }
+
+                        BenchResult result;
+                        result.kind = "cipher";
+                        result.algorithm = algorithm.name;
+                        result.backend = backend.name;
+                        result.mode = mode.name;
+                        result.padding = padding.name;
+                        result.bytes = size;
+
+                        result.operation = "encrypt";
+                        measure(result, options.minSeconds, [&] { encrypt(plaintext); });
+                        results.push_back(result);
+
+                        result.operation = "decrypt";
+                        measure(result, options.minSeconds, [&] {
+                            if (tag.empty())
+                                manager.decrypt(ciphertext);
+                            else
+                                manager.decrypt(ciphertext, tag);
+                        });
+                        results.push_back(result);
+
+                        std::cerr << algorithm.name << " " << backend.name << " " << mode.name << " "
+                            << padding.name << " " << size << " B: "
+                            << results[results.size() - 2].megabytesPerSecond << " / "
+                            << results.back().megabytesPerSecond << " MB/s\n";
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void writeCsv(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "kind,algorithm,backend,mode,padding,operation,bytes,iterations,"
+        "ns_per_op,mb_per_s,cycles_per_op,cycles_per_byte\n";
+    for (const auto& r : results) {
+        out << r.kind << ',' << r.algorithm << ',' << r.backend << ',' << r.mode << ',' << r.padding << ','
+            << r.operation << ',' << r.bytes << ',' << r.iterations << ',' << r.nsPerOp << ','
+            << r.megabytesPerSecond << ',' << r.cyclesPerOp << ',' << r.cyclesPerByte << '\n';
+    }
+}
+
+static void writeJson(std::ostream& out, const std::vector<BenchResult>& results, const BenchOptions& options) {
+    out << "{\n  \"threads\": " << options.threads
+        << ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+        << ",\n  \"tsc\": " << (BENCH_HAS_TSC ? "true" : "false")
+        << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"kind\": \"" << r.kind << "\", \"algorithm\": \"" << r.algorithm
+            << "\", \"backend\": \"" << r.backend << "\", \"mode\": \"" << r.mode
+            << "\", \"padding\": \"" << r.padding << "\", \"operation\": \"" << r.operation
+            << "\", \"bytes\": " << r.bytes << ", \"iterations\": " << r.iterations
+            << ", \"ns_per_op\": " << r.nsPerOp << ", \"mb_per_s\": " << r.megabytesPerSecond
+            << ", \"cycles_per_op\": " << r.cyclesPerOp << ", \"cycles_per_byte\": " << r.cyclesPerByte << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    try {
+        BenchOptions options = parseOptions(argc, argv);
+        std::mt19937_64 random(20240601);
+        std::vector<BenchResult> results;
+
+        if (options.keySetup) {
+            benchKeySetup(options, results, random);
+        }
+        if (options.cipher) {
+            benchCipher(options, results, random);
+        }
+
+        std::ofstream file;
+        if (!options.output.empty()) {
+            file.open(options.output);
+            if (!file) {
+                throw std::runtime_error("cannot create " + options.output);
+            }
+        }
+        std::ostream& out = options.output.empty() ? std::cout : file;
+        out.precision(6);
+        if (options.format == "json") {
+            writeJson(out, results, options);
+        }
+        else {
+            writeCsv(out, results);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "benchmark: " << e.what() << "\n" << USAGE;
+        return 1;
+    }
+    return 0;
+}
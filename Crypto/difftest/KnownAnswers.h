@@ -0,0 +1,97 @@
+#pragma once
+#include <vector>
+#include "EncryptorManager.h"
+
+struct KnownAnswer {
+    EncryptionAlgorithm algorithm;
+    const char* key;
+    const char* plaintext;
+    const char* ciphertext;
+};
+
+// Published DES vectors: the FIPS 46 worked example, NBS SP 500-20 variable
+// plaintext / variable key entries and two classic checks.
+inline const std::vector<KnownAnswer>& desKnownAnswers() {
+    static const std::vector<KnownAnswer> answers = {
+    { EncryptionAlgorithm::DES, "133457799bbcdff1", "0123456789abcdef", "85e813540f0ab405" },
+    { EncryptionAlgorithm::DES, "0101010101010101", "8000000000000000", "95f8a5e5dd31d900" },
+    { EncryptionAlgorithm::DES, "0101010101010101", "4000000000000000", "dd7f121ca5015619" },
+    { EncryptionAlgorithm::DES, "0101010101010101", "2000000000000000", "2e8653104f3834ea" },
+    { EncryptionAlgorithm::DES, "0101010101010101", "1000000000000000", "4bd388ff6cd81d4f" },
+    { EncryptionAlgorithm::DES, "8001010101010101", "0000000000000000", "95a8d72813daa94d" },
+    { EncryptionAlgorithm::DES, "4001010101010101", "0000000000000000", "0eec1487dd8c26d5" },
+    { EncryptionAlgorithm::DES, "0e329232ea6d0d73", "8787878787878787", "0000000000000000" },
+    { EncryptionAlgorithm::DES, "0123456789abcdef", "4e6f772069732074", "3fa40e8a984d4815" },
+    };
+    return answers;
+}
+
+// MARS and Serpent in this project do not reproduce the AES submission vectors,
+// and there are no DEAL vectors at hand, so these are pinned from the reference
+// classes instead. They catch drift in
+// the references themselves; the random trials then tie the fast engines to them.
+inline const std::vector<KnownAnswer>& pinnedAnswers() {
+    static const std::vector<KnownAnswer> answers = {
+    { EncryptionAlgorithm::DEAL, "00000000000000000000000000000000",
+        "00000000000000000000000000000000", "899be67c4356591d28e27d928d3adb92" },
+    { EncryptionAlgorithm::DEAL, "000102030405060708090a0b0c0d0e0f",
+        "00112233445566778899aabbccddeeff", "c0e40a5b6efc3676b1d481a8e2bd4f78" },
+    { EncryptionAlgorithm::DEAL, "000102030405060708090a0b0c0d0e0f1011121314151617",
+        "00112233445566778899aabbccddeeff", "63dd053ca3f7b03701fe8c6c630546cb" },
+    { EncryptionAlgorithm::DEAL, "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",
+        "00112233445566778899aabbccddeeff", "7bddacae492f9c1b23ea2b4e3f660658" },
+    { EncryptionAlgorithm::MARS, "00000000000000000000000000000000",
+        "00000000000000000000000000000000", "d4aee9c00836fb9e345699d01c9c0bcb" },
+    { EncryptionAlgorithm::MARS, "00000000000000000000000000000000",
+        "00112233445566778899aabbccddeeff", "ad18d9a5136a92b066c92967cfc7f0a2" },
+    { EncryptionAlgorithm::MARS, "80000000000000000000000000000000",
+        "00000000000000000000000000000000", "397a7ca80bf0db4059806b355a30a50d" },
+    { EncryptionAlgorithm::MARS, "80000000000000000000000000000000",
+        "00112233445566778899aabbccddeeff", "f2e9e895da082f3059ab7855db58a6dc" },
+    { EncryptionAlgorithm::MARS, "000102030405060708090a0b0c0d0e0f",
+        "00000000000000000000000000000000", "60c5791ef746f267ea2cb423d4ac72fb" },
+    { EncryptionAlgorithm::MARS, "000102030405060708090a0b0c0d0e0f",
+        "00112233445566778899aabbccddeeff", "06d0dbc6003edfab69f88c7bf3307004" },
+    { EncryptionAlgorithm::MARS, "000102030405060708090a0b0c0d0e0f1011121314151617",
+        "00112233445566778899aabbccddeeff", "4a38d7bd54170e2622fe0b784e4eff44" },
+    { EncryptionAlgorithm::MARS, "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",
+        "00112233445566778899aabbccddeeff", "04350eb42bfb133560d6ed5f508f2521" },
+    { EncryptionAlgorithm::SERPENT, "00000000000000000000000000000000",
+        "00000000000000000000000000000000", "ecf7efb6190f3879b915825067f42be1" },
+    { EncryptionAlgorithm::SERPENT, "00000000000000000000000000000000",
+        "00112233445566778899aabbccddeeff", "ebcc058d8b810e6dbd14afb0c91c5f93" },
+    { EncryptionAlgorithm::SERPENT, "80000000000000000000000000000000",
+        "00000000000000000000000000000000", "c3b239c0a748d590bee14ca149e6f5bc" },
+    { EncryptionAlgorithm::SERPENT, "80000000000000000000000000000000",
+        "00112233445566778899aabbccddeeff", "db8ede3a17561ae3d8879ee46f058331" },
+    { EncryptionAlgorithm::SERPENT, "000102030405060708090a0b0c0d0e0f",
+        "00000000000000000000000000000000", "22dd651ed9358362739030f761df1621" },
+    { EncryptionAlgorithm::SERPENT, "000102030405060708090a0b0c0d0e0f",
+        "00112233445566778899aabbccddeeff", "38b2c1b6b270a488508ba595e4b9148e" },
+    { EncryptionAlgorithm::SERPENT, "000102030405060708090a0b0c0d0e0f1011121314151617",
+        "00112233445566778899aabbccddeeff", "5158f2209ff4feecac65e85b09481b48" },
+    { EncryptionAlgorithm::SERPENT, "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",
+        "00112233445566778899aabbccddeeff", "430e57bddc5f328e036342140881217c" },
+    };
+    return answers;
+}
+
+struct GHashAnswer {
+    const char* h;
+    const char* aad;
+    const char* ciphertext;
+    const char* digest;
+};
+
+// GHASH(H, A, C) of test cases 2 and 4 in the GCM specification (McGrew and Viega).
+inline const std::vector<GHashAnswer>& ghashKnownAnswers() {
+    static const std::vector<GHashAnswer> answers = {
+    { "66e94bd4ef8a2c3b884cfa59ca342b2e", "", "0388dace60b6a392f328c2b971b2fe78",
+        "f38cbb1ad69223dcc3457ae5b6b0f885" },
+    { "b83b533708bf535d0aa6e52980d53b78", "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+        "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+        "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+        "698e57f70e6ecc7fd9463b7260a9ae5f" },
+    };
+    return answers;
+}
@@ -0,0 +1,1029 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <random>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <numeric>
+#include <list>
+#include <stdexcept>
+#include <memory_resource>
+#include "EncryptorManager.h"
+#include "KeyScheduleCache.h"
+#include "SessionPool.h"
+#include "PermutationTable.h"
+#include "SerpentConfig.h"
+#include "XTS.h"
+#include "KnownAnswers.h"
+
+// An engine checked against the reference class of the same algorithm, which
+// runs the generic ICrypt modes while candidates get the ones EncryptorManager
+// picks for their type. Parallel candidates run their mode through the shared
+// pool with tiny chunks, so the split points land inside short messages too.
+struct Candidate {
+    std::string name;
+    EncryptionAlgorithm algorithm;
+    std::function<ICrypt*()> make;
+    bool parallel;
+};
+
+struct HarnessOptions {
+    uint64_t trials = 1000000;
+    uint64_t first = 0;
+    uint64_t seed = 1;
+    unsigned threads = std::thread::hardware_concurrency();
+    bool katOnly = false;
+};
+
+static const char* USAGE =
+    "usage: difftest [options]\n"
+    "  --trials N      random trials, default 1000000\n"
+    "  --seed S        default 1\n"
+    "  --first N       index of the first trial; with --trials 1 replays a failure\n"
+    "  --threads N     default: all cores\n"
+    "  --kat-only      known answers only\n";
+
+static const CryptoMode MODES[] = {
+    CryptoMode::ECB, CryptoMode::CBC, CryptoMode::PCBC, CryptoMode::CFB,
+    CryptoMode::OFB, CryptoMode::CTR, CryptoMode::RandomDelta, CryptoMode::GCM };
+
+static const char* MODE_NAMES[] = { "ecb", "cbc", "pcbc", "cfb", "ofb", "ctr", "randomdelta", "gcm" };
+
+static const char* algorithmName(EncryptionAlgorithm algorithm) {
+    switch (algorithm) {
+    case EncryptionAlgorithm::DES: return "des";
+    case EncryptionAlgorithm::DEAL: return "deal";
+    case EncryptionAlgorithm::MARS: return "mars";
+    case EncryptionAlgorithm::SERPENT: return "serpent";
+    default: return "?";
+    }
+}
+
+static std::vector<Candidate> makeCandidates() {
+    std::vector<Candidate> candidates = {
+        { "des/optimized", EncryptionAlgorithm::DES, [] { return new DESTableEncryptor(); }, false },
+        { "des/optimized/parallel", EncryptionAlgorithm::DES, [] { return new DESTableEncryptor(); }, true },
+        { "des/reference/parallel", EncryptionAlgorithm::DES, [] { return new DESEncryptor(); }, true },
+        { "deal/optimized", EncryptionAlgorithm::DEAL, [] { return new DEALTableEncryptor(); }, false },
+        { "deal/optimized/parallel", EncryptionAlgorithm::DEAL, [] { return new DEALTableEncryptor(); }, true },
+        { "mars/reference/parallel", EncryptionAlgorithm::MARS, [] { return new MARS(); }, true },
+        { "serpent/reference/parallel", EncryptionAlgorithm::SERPENT, [] { return new Serpent(); }, true },
+        { "serpent/optimized/parallel", EncryptionAlgorithm::SERPENT, [] { return new SerpentBitslice(); }, true },
+    };
+    const std::pair<const char*, SerpentSimdLevel> levels[] = {
+        { "serpent/optimized/scalar", SerpentSimdLevel::None },
+        { "serpent/optimized/sse2", SerpentSimdLevel::Sse2 },
+        { "serpent/optimized/avx2", SerpentSimdLevel::Avx2 } };
+    for (const auto& level : levels) {
+        if (level.second <= serpentSimdLevel()) {
+            SerpentSimdLevel value = level.second;
+            candidates.push_back({ level.first, EncryptionAlgorithm::SERPENT,
+                [value] { return (new SerpentBitslice())->setSimdLevel(value); }, false });
+        }
+    }
+    return candidates;
+}
+
+static std::vector<uint8_t> fromHex(const char* text) {
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; text[i] != 0 && text[i + 1] != 0; i += 2) {
+        bytes.push_back(static_cast<uint8_t>(std::stoul(std::string(text + i, 2), nullptr, 16)));
+    }
+    return bytes;
+}
+
+static std::string toHex(const uint8_t* data, size_t size) {
+    std::ostringstream out;
+    for (size_t i = 0; i < size; ++i) {
+        out << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(data[i]);
+    }
+    return out.str();
+}
+
+// Every known answer through the reference class and every candidate, both as a
+// single block and replicated through the batch path (long enough for the
+// 64-lane DES and the widest Serpent kernel).
+static size_t checkKnownAnswers(const std::vector<Candidate>& candidates) {
+    std::vector<KnownAnswer> answers = desKnownAnswers();
+    answers.insert(answers.end(), pinnedAnswers().begin(), pinnedAnswers().end());
+
+    size_t failures = 0;
+    auto check = [&](const std::string& engine, ICrypt& cipher, const KnownAnswer& answer) {
+        std::vector<uint8_t> key = fromHex(answer.key);
+        std::vector<uint8_t> plaintext = fromHex(answer.plaintext);
+        std::vector<uint8_t> expected = fromHex(answer.ciphertext);
+        cipher.setKey(key);
+
+        const size_t copies = 130;
+        size_t length = plaintext.size();
+        std::vector<uint8_t> batch(copies * length), out(copies * length), back(copies * length);
+        for (size_t i = 0; i < copies; ++i) {
+            std::copy(plaintext.begin(), plaintext.end(), batch.begin() + i * length);
+        }
+        cipher.encryptBlocks(batch.data(), out.data(), copies);
+        cipher.decryptBlocks(out.data(), back.data(), copies);
+
+        const char* failed = nullptr;
+        if (cipher.encrypt(plaintext) != expected) {
+            failed = "encrypt";
+        }
+        else if (cipher.decrypt(expected) != plaintext) {
+            failed = "decrypt";
+        }
+        else if (back != batch) {
+            failed = "batch decrypt";
+        }
+        for (size_t i = 0; !failed && i < copies; ++i) {
+            if (!std::equal(expected.begin(), expected.end(), out.begin() + i * length)) {
+                failed = "batch encrypt";
+            }
+        }
+        if (failed) {
+            ++failures;
+            std::cout << "KAT FAIL " << engine << " " << failed << " key " << answer.key
+                << " plaintext " << answer.plaintext << " ciphertext " << answer.ciphertext << "\n";
+        }
+    };
+
+    for (const auto& answer : answers) {
+        std::unique_ptr<ICrypt> reference(makeCipher(answer.algorithm, CipherBackend::Reference));
+        check(std::string(algorithmName(answer.algorithm)) + "/reference", *reference, answer);
+        for (const auto& candidate : candidates) {
+            if (candidate.algorithm == answer.algorithm && !candidate.parallel) {
+                std::unique_ptr<ICrypt> cipher(candidate.make());
+                check(candidate.name, *cipher, answer);
+            }
+        }
+    }
+    std::cout << "known answers: " << answers.size() << " vectors, " << failures << " failures\n";
+    return failures;
+}
+
+// The GCM specification's GHASH values through every kernel this CPU has, then
+// the kernels against the table on random keys and lengths.
+static size_t checkGHash() {
+    std::vector<GHashLevel> levels = { GHashLevel::Table };
+    if (ghashLevel() == GHashLevel::Pclmul) {
+        levels.push_back(GHashLevel::Pclmul);
+    }
+    auto digest = [](GHashLevel level, const std::vector<uint8_t>& h, const std::vector<uint8_t>& aad,
+        const std::vector<uint8_t>& data) {
+        GHash ghash;
+        ghash.setKey(h.data());
+        ghash.setLevel(level);
+        ghash.updatePadded(aad.data(), aad.size());
+        ghash.updatePadded(data.data(), data.size());
+        uint8_t lengths[16];
+        uint64ToBytes(aad.size() * 8, lengths);
+        uint64ToBytes(data.size() * 8, lengths + 8);
+        ghash.update(lengths, 1);
+        std::vector<uint8_t> out(16);
+        ghash.digest(out.data());
+        return out;
+    };
+
+    size_t failures = 0;
+    for (const auto& answer : ghashKnownAnswers()) {
+        for (GHashLevel level : levels) {
+            if (digest(level, fromHex(answer.h), fromHex(answer.aad), fromHex(answer.ciphertext)) != fromHex(answer.digest)) {
+                ++failures;
+                std::cout << "GHASH FAIL level " << static_cast<int>(level) << " h " << answer.h << "\n";
+            }
+        }
+    }
+
+    const int trials = 2000;
+    std::mt19937_64 random(1);
+    for (int i = 0; i < trials && levels.size() > 1; ++i) {
+        std::vector<uint8_t> h(16), aad(random() % 40), data(random() % 300);
+        for (auto* bytes : { &h, &aad, &data }) {
+            for (auto& byte : *bytes) byte = static_cast<uint8_t>(random());
+        }
+        if (digest(GHashLevel::Pclmul, h, aad, data) != digest(GHashLevel::Table, h, aad, data)) {
+            ++failures;
+            std::cout << "GHASH FAIL pclmul h " << toHex(h.data(), h.size()) << " length " << data.size() << "\n";
+        }
+    }
+    std::cout << "ghash: " << ghashKnownAnswers().size() << " vectors, " << levels.size() << " kernels, "
+        << failures << " failures\n";
+    return failures;
+}
+
+// Every PermutationTable::apply overload against permuteBits: the DES and
+// Serpent tables in both bit orders, then random pBlocks of up to 128 bits
+// with repeated and unused input bits. The uint64_t overload only where both
+// sides fit in 64 bits.
+static size_t checkPermutations() {
+    struct Table {
+        const char* name;
+        std::vector<uint16_t> pBlock;
+        bool isOneIndexed;
+    };
+    std::vector<Table> tables = {
+        { "des ip", INITIAL_PERMUTATION, true }, { "des fp", FINAL_PERMUTATION, true },
+        { "des expand", P_BLOCK_EXPAND, true }, { "des p", P_BLOCK_PLAIN, true },
+        { "des pc1", PC_1, true }, { "des pc2", PC_2, true },
+        { "serpent ip", IP_TABLE, false }, { "serpent fp", FP_TABLE, false } };
+    const size_t builtIn = tables.size();
+    const int randomTables = 500;
+    std::mt19937_64 random(5);
+    for (int i = 0; i < randomTables; ++i) {
+        bool isOneIndexed = random() % 2;
+        size_t inputBits = 1 + random() % 128;
+        std::vector<uint16_t> pBlock(1 + random() % 128);
+        for (auto& index : pBlock) {
+            index = static_cast<uint16_t>(random() % inputBits + (isOneIndexed ? 1 : 0));
+        }
+        tables.push_back({ "random", pBlock, isOneIndexed });
+    }
+
+    std::pmr::unsynchronized_pool_resource resource;
+    size_t failures = 0;
+    size_t checked = 0;
+    for (size_t t = 0; t < tables.size(); ++t) {
+        const Table& table = tables[t];
+        for (bool reverseBitOrder : { false, true }) {
+            PermutationTable compiled(table.pBlock, reverseBitOrder, table.isOneIndexed);
+            size_t inputLength = compiled.getInputLength();
+            size_t outputLength = compiled.getOutputLength();
+            bool narrow = inputLength <= 8 && outputLength <= 8;
+
+            const char* failed = nullptr;
+            for (int sample = 0; sample < 20 && !failed; ++sample, ++checked) {
+                std::vector<uint8_t> data(inputLength);
+                for (auto& byte : data) byte = static_cast<uint8_t>(random());
+                std::vector<uint8_t> expected = permuteBits(data, table.pBlock, reverseBitOrder, table.isOneIndexed);
+
+                std::vector<uint8_t> inPlace(std::max(inputLength, outputLength));
+                std::copy(data.begin(), data.end(), inPlace.begin());
+                compiled.apply(inPlace.data(), inPlace.data());
+                std::pmr::vector<uint8_t> pmrData(data.begin(), data.end(), &resource);
+
+                if (compiled.apply(data) != expected) {
+                    failed = "vector";
+                }
+                else if (!std::equal(expected.begin(), expected.end(), inPlace.begin())) {
+                    failed = "in-place pointer";
+                }
+                else if (!std::equal(expected.begin(), expected.end(), compiled.apply(pmrData).begin())) {
+                    failed = "pmr vector";
+                }
+                else if (narrow) {
+                    uint8_t block[8] = {};
+                    uint8_t wanted[8] = {};
+                    std::copy(data.begin(), data.end(), block);
+                    std::copy(expected.begin(), expected.end(), wanted);
+                    if (compiled.apply(bytesToUint64(block)) != bytesToUint64(wanted)) {
+                        failed = "uint64_t";
+                    }
+                }
+            }
+            if (failed) {
+                ++failures;
+                std::cout << "PERMUTATION FAIL " << table.name << " " << t - (t < builtIn ? 0 : builtIn)
+                    << (reverseBitOrder ? " reversed" : "") << ": " << failed << "\n";
+            }
+        }
+    }
+    std::cout << "permutations: " << builtIn << " built-in and " << randomTables << " random tables, "
+        << checked << " blocks, " << failures << " failures\n";
+    return failures;
+}
+
+// KeyScheduleCache::get against freshly keyed engines. First a random sequence
+// over three times as many keys as the cache holds, with hits and evictions
+// checked against an LRU model; then threads that start on the same keys at
+// once, so they miss together, and must still end up sharing one engine per key.
+static size_t checkKeyCache() {
+    static const EncryptionAlgorithm ALGORITHMS[] = {
+        EncryptionAlgorithm::DES, EncryptionAlgorithm::DEAL, EncryptionAlgorithm::MARS, EncryptionAlgorithm::SERPENT };
+    struct Key {
+        EncryptionAlgorithm algorithm;
+        CipherBackend backend;
+        std::vector<uint8_t> key;
+        std::vector<uint8_t> block;
+        std::vector<uint8_t> expected;
+    };
+    std::mt19937_64 random(6);
+    const size_t capacity = 8;
+    std::vector<Key> keys(3 * capacity);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        Key& k = keys[i];
+        k.algorithm = ALGORITHMS[random() % 4];
+        k.backend = random() % 2 ? CipherBackend::Optimized : CipherBackend::Reference;
+        k.key.resize(k.algorithm == EncryptionAlgorithm::DES ? 8 : 16);
+        for (auto& byte : k.key) byte = static_cast<uint8_t>(random());
+        // the same key bytes on the other backend are a different entry
+        if (i % 3 == 2) {
+            k.algorithm = keys[i - 1].algorithm;
+            k.backend = keys[i - 1].backend == CipherBackend::Optimized ? CipherBackend::Reference : CipherBackend::Optimized;
+            k.key = keys[i - 1].key;
+        }
+        std::unique_ptr<ICrypt> fresh(makeCipher(k.algorithm, k.backend));
+        fresh->setKey(k.key);
+        k.block.resize(fresh->getBlockLength());
+        for (auto& byte : k.block) byte = static_cast<uint8_t>(random());
+        k.expected = fresh->encrypt(k.block);
+    }
+    auto matches = [](ICrypt& engine, const Key& k) {
+        return engine.encrypt(k.block) == k.expected;
+    };
+
+    size_t failures = 0;
+    KeyScheduleCache cache(capacity);
+    std::list<size_t> model;    // most recently used first
+    std::vector<ICrypt*> cached(keys.size(), nullptr);
+    KeyCacheStats expected;
+    const int lookups = 3000;
+    for (int i = 0; i < lookups; ++i) {
+        size_t k = random() % keys.size();
+        std::shared_ptr<ICrypt> engine = cache.get(keys[k].algorithm, keys[k].backend, keys[k].key);
+        auto found = std::find(model.begin(), model.end(), k);
+
+        const char* failed = nullptr;
+        if (found != model.end()) {
+            ++expected.hits;
+            model.erase(found);
+            if (engine.get() != cached[k]) {
+                failed = "hit expanded the key again";
+            }
+        }
+        else {
+            ++expected.misses;
+            if (model.size() == capacity) {
+                model.pop_back();
+                ++expected.evictions;
+            }
+        }
+        model.push_front(k);
+        cached[k] = engine.get();
+        if (!failed && !matches(*engine, keys[k])) {
+            failed = "schedule differs from a fresh engine";
+        }
+        if (failed) {
+            ++failures;
+            std::cout << "KEY CACHE FAIL lookup " << i << " key " << k << " " << algorithmName(keys[k].algorithm)
+                << ": " << failed << "\n";
+        }
+    }
+    KeyCacheStats stats = cache.getStats();
+    if (stats.hits != expected.hits || stats.misses != expected.misses || stats.evictions != expected.evictions
+        || stats.size != model.size()) {
+        ++failures;
+        std::cout << "KEY CACHE FAIL stats: " << stats.hits << " hits, " << stats.misses << " misses, "
+            << stats.evictions << " evictions, expected " << expected.hits << ", " << expected.misses << ", "
+            << expected.evictions << "\n";
+    }
+
+    const unsigned threads = 8;
+    const int rounds = 4;
+    KeyScheduleCache shared(keys.size());
+    std::vector<std::vector<ICrypt*>> seen(threads, std::vector<ICrypt*>(keys.size(), nullptr));
+    std::atomic<unsigned> ready{ 0 };
+    std::atomic<size_t> wrong{ 0 };
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::vector<size_t> order(keys.size());
+            std::iota(order.begin(), order.end(), size_t(0));
+            std::mt19937_64 shuffle(t);
+            ready.fetch_add(1);
+            while (ready.load() != threads) {
+                std::this_thread::yield();
+            }
+            // the first round in the same order everywhere, the rest shuffled
+            for (int round = 0; round < rounds; ++round) {
+                for (size_t k : order) {
+                    std::shared_ptr<ICrypt> engine = shared.get(keys[k].algorithm, keys[k].backend, keys[k].key);
+                    if (!matches(*engine, keys[k]) || (seen[t][k] && seen[t][k] != engine.get())) {
+                        wrong.fetch_add(1);
+                    }
+                    seen[t][k] = engine.get();
+                }
+                std::shuffle(order.begin(), order.end(), shuffle);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (unsigned t = 1; t < threads; ++t) {
+        if (seen[t] != seen[0]) {
+            wrong.fetch_add(1);
+        }
+    }
+    stats = shared.getStats();
+    if (wrong.load() != 0 || stats.hits + stats.misses != threads * rounds * keys.size()
+        || stats.evictions != 0 || stats.size != keys.size()) {
+        ++failures;
+        std::cout << "KEY CACHE FAIL concurrent: " << wrong.load() << " wrong engines, " << stats.misses
+            << " misses, " << stats.size << " entries\n";
+    }
+
+    std::cout << "key cache: " << lookups << " lookups, " << threads << " threads sharing " << keys.size()
+        << " keys (" << stats.misses << " misses), " << failures << " failures\n";
+    return failures;
+}
+
+// Sessions back from a SessionPool against freshly built managers. The previous
+// user leaves a random IV, AAD, a stream half done and keystream prefetch
+// behind; none of it may show in the next session. GCM must also refuse to
+// encrypt until it gets an IV. ISO 10126 pads with random bytes, so it is left out.
+static size_t checkSessions() {
+    static const EncryptionAlgorithm ALGORITHMS[] = {
+        EncryptionAlgorithm::DES, EncryptionAlgorithm::DEAL, EncryptionAlgorithm::MARS, EncryptionAlgorithm::SERPENT };
+    static const Pudding PADDINGS[] = { Pudding::Zeros, Pudding::ANSIX923, Pudding::PKCS7 };
+    const int trials = 300;
+    std::mt19937_64 random(7);
+    auto bytes = [&](size_t size) {
+        std::vector<uint8_t> result(size);
+        for (auto& byte : result) byte = static_cast<uint8_t>(random());
+        return result;
+    };
+
+    SessionPool pool(4);
+    size_t failures = 0;
+    for (int trial = 0; trial < trials; ++trial) {
+        EncryptionAlgorithm algorithm = ALGORITHMS[random() % 4];
+        CipherBackend backend = random() % 2 ? CipherBackend::Optimized : CipherBackend::Reference;
+        // GCM needs a 128-bit block
+        CryptoMode mode = MODES[random() % (algorithm == EncryptionAlgorithm::DES ? 7 : 8)];
+        Pudding padding = PADDINGS[random() % 3];
+        std::vector<uint8_t> key = bytes(algorithm == EncryptionAlgorithm::DES ? 8 : 16);
+
+        {
+            CryptoSession previous = pool.acquire(algorithm, backend, key, mode, padding);
+            EncryptorManager& manager = previous.getManager();
+            size_t length = static_cast<size_t>(manager.getBlockLength());
+            manager.setIV(bytes(length));
+            if (mode == CryptoMode::GCM) {
+                manager.setAAD(bytes(1 + random() % 40));
+            }
+            if (mode == CryptoMode::OFB || mode == CryptoMode::CTR) {
+                manager.setKeystreamPrefetch(1 + random() % 64);
+            }
+            manager.begin(StreamDirection::Encrypt);
+            manager.update(bytes(random() % (3 * length)));
+        }
+        uint64_t reused = pool.getStats().reused;
+        CryptoSession session = pool.acquire(algorithm, backend, key, mode, padding);
+        EncryptorManager& pooled = session.getManager();
+        std::vector<uint8_t> zeroIV(pooled.getBlockLength());
+        EncryptorManager fresh(key, algorithm, mode, padding, zeroIV, backend);
+        std::vector<uint8_t> data = bytes(random() % 200);
+
+        auto refuses = [](const std::function<void()>& call) {
+            try {
+                call();
+            }
+            catch (const std::logic_error&) {
+                return true;
+            }
+            return false;
+        };
+        const char* failed = nullptr;
+        bool streamDropped = refuses([&] { pooled.final(); });
+        bool nonceDropped = mode != CryptoMode::GCM || refuses([&] { pooled.encrypt(data); });
+        if (mode == CryptoMode::GCM) {
+            pooled.setIV(zeroIV);
+        }
+        if (pool.getStats().reused != reused + 1) {
+            failed = "session was not reused";
+        }
+        else if (!streamDropped) {
+            failed = "stream left open";
+        }
+        else if (!nonceDropped) {
+            failed = "GCM encrypts without an IV";
+        }
+        else if (pooled.encrypt(data) != fresh.encrypt(data)) {
+            failed = "encrypt";
+        }
+        else if (mode == CryptoMode::GCM && pooled.getTag() != fresh.getTag()) {
+            failed = "tag";
+        }
+        else if (pooled.getKeystreamStats().resets != 0) {
+            failed = "keystream prefetch left on";
+        }
+        if (failed) {
+            ++failures;
+            std::cout << "SESSION FAIL trial " << trial << " " << algorithmName(algorithm) << " "
+                << MODE_NAMES[static_cast<int>(mode)] << ": " << failed << "\n";
+        }
+    }
+    std::cout << "sessions: " << trials << " trials, " << failures << " failures\n";
+    return failures;
+}
+
+// XTS over the optimized engines against the reference ones: random sector
+// sizes and tails that need ciphertext stealing, the parallel path, in-place
+// single sectors and the round trip.
+static size_t checkXTS(ThreadPool& pool) {
+    static const EncryptionAlgorithm ALGORITHMS[] = {
+        EncryptionAlgorithm::DEAL, EncryptionAlgorithm::MARS, EncryptionAlgorithm::SERPENT };
+    auto shared = std::shared_ptr<ThreadPool>(&pool, [](ThreadPool*) {});
+    const int trials = 300;
+    std::mt19937_64 random(2);
+    size_t failures = 0;
+    for (int trial = 0; trial < trials; ++trial) {
+        EncryptionAlgorithm algorithm = ALGORITHMS[random() % 3];
+        std::vector<uint8_t> key(2 * (16 + 8 * (random() % 3)));
+        for (auto& byte : key) byte = static_cast<uint8_t>(random());
+        size_t sectorSize = 16 + random() % 1100;
+        size_t sectors = 1 + random() % 24;
+        std::vector<uint8_t> data((sectors - 1) * sectorSize + 16 + random() % (sectorSize - 15));
+        for (auto& byte : data) byte = static_cast<uint8_t>(random());
+        uint64_t first = random();
+
+        XTSEncryptor reference(key, algorithm, sectorSize, CipherBackend::Reference);
+        XTSEncryptor optimized(key, algorithm, sectorSize, CipherBackend::Optimized);
+        if (trial % 2) {
+            optimized.setParallel(shared);
+        }
+        std::vector<uint8_t> expected = reference.encryptSectors(first, data);
+        std::vector<uint8_t> single(data.begin(), data.begin() + std::min(sectorSize, data.size()));
+        optimized.encryptSector(first, single.data(), single.data(), single.size());
+
+        const char* failed = nullptr;
+        if (optimized.encryptSectors(first, data) != expected) {
+            failed = "encrypt";
+        }
+        else if (optimized.decryptSectors(first, expected) != data) {
+            failed = "decrypt";
+        }
+        else if (!std::equal(single.begin(), single.end(), expected.begin())) {
+            failed = "in-place sector";
+        }
+        if (failed) {
+            ++failures;
+            std::cout << "XTS FAIL trial " << trial << " " << algorithmName(algorithm) << " " << failed
+                << " sector " << sectorSize << " length " << data.size() << "\n";
+        }
+    }
+    std::cout << "xts: " << trials << " trials, " << failures << " failures\n";
+    return failures;
+}
+
+// OFB and CTR with keystream prefetch against the same mode without it: a
+// stream of messages of random lengths, sometimes with a pause that lets the
+// thread fill the ring, then one-shot calls that restart at the IV.
+static size_t checkPrefetch() {
+    static const EncryptionAlgorithm ALGORITHMS[] = {
+        EncryptionAlgorithm::DES, EncryptionAlgorithm::DEAL, EncryptionAlgorithm::MARS, EncryptionAlgorithm::SERPENT };
+    const int trials = 100;
+    std::mt19937_64 random(3);
+    size_t failures = 0;
+    for (int trial = 0; trial < trials; ++trial) {
+        EncryptionAlgorithm algorithm = ALGORITHMS[random() % 4];
+        CryptoMode mode = trial % 2 ? CryptoMode::CTR : CryptoMode::OFB;
+        std::vector<uint8_t> key(algorithm == EncryptionAlgorithm::DES ? 8 : 16);
+        std::vector<uint8_t> iv(16);
+        for (auto& byte : key) byte = static_cast<uint8_t>(random());
+        for (auto& byte : iv) byte = static_cast<uint8_t>(random());
+
+        EncryptorManager plain(key, algorithm, mode, Pudding::PKCS7, iv, CipherBackend::Optimized);
+        EncryptorManager prefetched(key, algorithm, mode, Pudding::PKCS7, iv, CipherBackend::Optimized);
+        prefetched.setKeystreamPrefetch(1 + random() % 512);
+
+        const char* failed = nullptr;
+        plain.begin(StreamDirection::Encrypt);
+        prefetched.begin(StreamDirection::Encrypt);
+        for (int message = 0; message < 20 && !failed; ++message) {
+            std::vector<uint8_t> data(random() % 1500);
+            for (auto& byte : data) byte = static_cast<uint8_t>(random());
+            std::vector<uint8_t> expected(data.size() + 16);
+            std::vector<uint8_t> actual(data.size() + 16);
+            size_t written = plain.update(data.data(), data.size(), expected.data());
+            if (prefetched.update(data.data(), data.size(), actual.data()) != written
+                || !std::equal(expected.begin(), expected.begin() + written, actual.begin())) {
+                failed = "stream";
+            }
+            if (random() % 2) {
+                std::this_thread::sleep_for(std::chrono::microseconds(random() % 200));
+            }
+        }
+        for (int message = 0; message < 5 && !failed; ++message) {
+            std::vector<uint8_t> data(random() % 3000);
+            for (auto& byte : data) byte = static_cast<uint8_t>(random());
+            std::vector<uint8_t> expected = plain.encrypt(data);
+            if (prefetched.encrypt(data) != expected) {
+                failed = "encrypt";
+            }
+            else if (prefetched.decrypt(expected) != data) {
+                failed = "decrypt";
+            }
+        }
+        if (failed) {
+            ++failures;
+            std::cout << "PREFETCH FAIL trial " << trial << " " << algorithmName(algorithm) << " "
+                << MODE_NAMES[static_cast<int>(mode)] << " " << failed << "\n";
+        }
+    }
+    std::cout << "prefetch: " << trials << " trials, " << failures << " failures\n";
+    return failures;
+}
+
+// Streaming decryption in random chunks against one-shot decrypt() on the same
+// ciphertext, valid or damaged: both return the same plaintext or both throw.
+static size_t checkDecryptPaths() {
+    static const EncryptionAlgorithm ALGORITHMS[] = {
+        EncryptionAlgorithm::DES, EncryptionAlgorithm::DEAL, EncryptionAlgorithm::MARS, EncryptionAlgorithm::SERPENT };
+    static const Pudding PADDINGS[] = { Pudding::Zeros, Pudding::ANSIX923, Pudding::PKCS7, Pudding::ISO10126 };
+    const int trials = 2000;
+    std::mt19937_64 random(4);
+    size_t failures = 0;
+    for (int trial = 0; trial < trials; ++trial) {
+        EncryptionAlgorithm algorithm = ALGORITHMS[random() % 4];
+        // GCM has no decryption without a tag
+        CryptoMode mode = MODES[random() % 7];
+        Pudding padding = PADDINGS[random() % 4];
+        std::vector<uint8_t> key(algorithm == EncryptionAlgorithm::DES ? 8 : 16);
+        std::vector<uint8_t> iv(16);
+        for (auto& byte : key) byte = static_cast<uint8_t>(random());
+        for (auto& byte : iv) byte = static_cast<uint8_t>(random());
+        EncryptorManager manager(key, algorithm, mode, padding, iv, CipherBackend::Optimized);
+        size_t length = static_cast<size_t>(manager.getBlockLength());
+
+        std::vector<uint8_t> plaintext(random() % 4 ? random() % 100 : length * (random() % 6));
+        for (auto& byte : plaintext) byte = static_cast<uint8_t>(random() % 4 ? random() : 0);
+        std::vector<uint8_t> ciphertext = manager.encrypt(plaintext);
+        unsigned damage = random() % 4;
+        if (damage == 1 && !ciphertext.empty()) {
+            ciphertext[ciphertext.size() - 1 - random() % length] ^= static_cast<uint8_t>(1 + random() % 255);
+        }
+        else if (damage == 2) {
+            ciphertext.resize(length * (random() % 5));
+            for (auto& byte : ciphertext) byte = static_cast<uint8_t>(random());
+        }
+
+        const char* oneShotError = nullptr;
+        std::vector<uint8_t> oneShot;
+        try {
+            oneShot = manager.decrypt(ciphertext);
+        }
+        catch (const std::invalid_argument&) {
+            oneShotError = "throws";
+        }
+        const char* streamError = nullptr;
+        std::vector<uint8_t> streamed;
+        try {
+            manager.begin(StreamDirection::Decrypt);
+            for (size_t done = 0; done < ciphertext.size();) {
+                size_t chunk = std::min<size_t>(ciphertext.size() - done, random() % (3 * length));
+                std::vector<uint8_t> part = manager.update(
+                    std::vector<uint8_t>(ciphertext.begin() + done, ciphertext.begin() + done + chunk));
+                streamed.insert(streamed.end(), part.begin(), part.end());
+                done += chunk;
+            }
+            std::vector<uint8_t> last = manager.final();
+            streamed.insert(streamed.end(), last.begin(), last.end());
+        }
+        catch (const std::invalid_argument&) {
+            streamError = "throws";
+        }
+
+        const char* failed = nullptr;
+        if ((oneShotError == nullptr) != (streamError == nullptr) || (oneShotError == nullptr && oneShot != streamed)) {
+            failed = "one-shot and streaming differ";
+        }
+        // Zeros cannot tell trailing zero bytes of the message from padding
+        else if (damage == 0 && (padding != Pudding::Zeros || plaintext.empty() || plaintext.back() != 0)
+            && (oneShotError != nullptr || oneShot != plaintext)) {
+            failed = "round trip";
+        }
+        if (failed) {
+            ++failures;
+            std::cout << "DECRYPT FAIL trial " << trial << " " << algorithmName(algorithm) << " "
+                << MODE_NAMES[static_cast<int>(mode)] << " padding " << static_cast<int>(padding) << " length "
+                << ciphertext.size() << " damage " << damage << ": " << failed << "\n";
+        }
+    }
+    std::cout << "decrypt paths: " << trials << " trials, " << failures << " failures\n";
+    return failures;
+}
+
+// GCM through EncryptorManager on messages of any byte length against the
+// specification built from parts: the ciphertext is the CTR keystream cut to the
+// plaintext length, the tag GHASH(H, A, C) ^ E(J0) with the lengths in bits.
+// One-shot and streaming in random chunks, both directions, a damaged tag, and
+// a second encryption under the same nonce, which must throw.
+static size_t checkGCM() {
+    static const EncryptionAlgorithm ALGORITHMS[] = {
+        EncryptionAlgorithm::DEAL, EncryptionAlgorithm::MARS, EncryptionAlgorithm::SERPENT };
+    const int trials = 500;
+    std::mt19937_64 random(8);
+    auto bytes = [&](size_t size) {
+        std::vector<uint8_t> result(size);
+        for (auto& byte : result) byte = static_cast<uint8_t>(random());
+        return result;
+    };
+    auto ghashOf = [](const uint8_t* h, const std::vector<uint8_t>& aad, const std::vector<uint8_t>& data,
+        uint8_t* out) {
+        GHash ghash;
+        ghash.setKey(h);
+        ghash.updatePadded(aad.data(), aad.size());
+        ghash.updatePadded(data.data(), data.size());
+        uint8_t lengths[16];
+        uint64ToBytes(aad.size() * 8, lengths);
+        uint64ToBytes(data.size() * 8, lengths + 8);
+        ghash.update(lengths, 1);
+        ghash.digest(out);
+    };
+
+    size_t failures = 0;
+    for (int trial = 0; trial < trials; ++trial) {
+        EncryptionAlgorithm algorithm = ALGORITHMS[random() % 3];
+        CipherBackend backend = random() % 2 ? CipherBackend::Optimized : CipherBackend::Reference;
+        std::vector<uint8_t> key = bytes(16 + 8 * (random() % 3));
+        std::vector<uint8_t> IV = bytes(random() % 2 ? 12 : 1 + random() % 32);
+        std::vector<uint8_t> aad = bytes(random() % 40);
+        std::vector<uint8_t> plaintext = bytes(random() % 4 ? random() % 300 : 16 * (random() % 5));
+
+        std::unique_ptr<ICrypt> reference(makeCipher(algorithm, CipherBackend::Reference));
+        reference->setKey(key);
+        uint8_t h[16] = {};
+        uint8_t j0[16] = {};
+        reference->encryptBlock(h, h);
+        if (IV.size() == 12) {
+            std::copy(IV.begin(), IV.end(), j0);
+            j0[15] = 1;
+        }
+        else {
+            ghashOf(h, {}, IV, j0);
+        }
+        std::vector<uint8_t> expected(plaintext.size());
+        uint8_t counter[16];
+        uint8_t keystream[16];
+        std::copy(j0, j0 + 16, counter);
+        for (size_t done = 0; done < plaintext.size(); done += 16) {
+            uint32_t low = static_cast<uint32_t>(bytesToUint64(counter + 8)) + 1;
+            for (int j = 0; j < 4; ++j) {
+                counter[12 + j] = static_cast<uint8_t>(low >> (24 - 8 * j));
+            }
+            reference->encryptBlock(counter, keystream);
+            for (size_t i = done; i < std::min(done + 16, plaintext.size()); ++i) {
+                expected[i] = plaintext[i] ^ keystream[i - done];
+            }
+        }
+        std::vector<uint8_t> expectedTag(16);
+        uint8_t mask[16];
+        ghashOf(h, aad, expected, expectedTag.data());
+        reference->encryptBlock(j0, mask);
+        xorBits(expectedTag.data(), mask, expectedTag.data(), 16);
+
+        EncryptorManager manager(key, algorithm, CryptoMode::GCM, Pudding::PKCS7, IV, backend);
+        manager.setAAD(aad);
+        const char* failed = nullptr;
+        std::vector<uint8_t> ciphertext = manager.encrypt(plaintext);
+        if (ciphertext != expected) {
+            failed = "encrypt";
+        }
+        else if (manager.getTag() != expectedTag) {
+            failed = "tag";
+        }
+        else if (manager.decrypt(ciphertext, expectedTag) != plaintext) {
+            failed = "decrypt";
+        }
+        else {
+            try {
+                manager.encrypt(plaintext);
+                failed = "nonce used twice";
+            }
+            catch (const std::logic_error&) {
+            }
+        }
+
+        // the same message in chunks of any size, both ways
+        for (StreamDirection direction : { StreamDirection::Encrypt, StreamDirection::Decrypt }) {
+            if (failed) {
+                break;
+            }
+            const std::vector<uint8_t>& input = direction == StreamDirection::Encrypt ? plaintext : expected;
+            std::vector<uint8_t> streamed;
+            manager.setIV(IV).begin(direction);
+            for (size_t done = 0; done < input.size();) {
+                size_t chunk = std::min<size_t>(input.size() - done, random() % 40);
+                std::vector<uint8_t> part = manager.update(
+                    std::vector<uint8_t>(input.begin() + done, input.begin() + done + chunk));
+                streamed.insert(streamed.end(), part.begin(), part.end());
+                done += chunk;
+            }
+            std::vector<uint8_t> last = manager.final();
+            streamed.insert(streamed.end(), last.begin(), last.end());
+            if (streamed != (direction == StreamDirection::Encrypt ? expected : plaintext)) {
+                failed = direction == StreamDirection::Encrypt ? "stream encrypt" : "stream decrypt";
+            }
+            else if (!manager.verifyTag(expectedTag)) {
+                failed = direction == StreamDirection::Encrypt ? "stream encrypt tag" : "stream decrypt tag";
+            }
+        }
+
+        if (!failed) {
+            std::vector<uint8_t> damaged = expectedTag;
+            damaged[random() % 16] ^= static_cast<uint8_t>(1 + random() % 255);
+            try {
+                manager.decrypt(ciphertext, damaged);
+                failed = "damaged tag accepted";
+            }
+            catch (const std::invalid_argument&) {
+            }
+        }
+        if (failed) {
+            ++failures;
+            std::cout << "GCM FAIL trial " << trial << " " << algorithmName(algorithm) << " length "
+                << plaintext.size() << " iv " << IV.size() << ": " << failed << "\n";
+        }
+    }
+    std::cout << "gcm: " << trials << " trials, " << failures << " failures\n";
+    return failures;
+}
+
+static uint64_t splitMix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Mostly short messages, some straddling multiples of 64 blocks (the DES
+// bitslice group) and a tail of long ones for the parallel chunking.
+static size_t randomBlockCount(std::mt19937_64& random) {
+    unsigned bucket = random() % 10;
+    if (bucket < 3) return 1 + random() % 16;
+    if (bucket < 7) return 1 + random() % 200;
+    if (bucket < 9) return 64 * (1 + random() % 8) + random() % 5 - 2;
+    return 200 + random() % 1800;
+}
+
+class Harness {
+private:
+    const std::vector<Candidate>& candidates;
+    ThreadPool& pool;
+    uint64_t seed;
+    std::mutex reportMutex;
+    std::atomic<uint64_t> failures{ 0 };
+    std::atomic<uint64_t> comparisons{ 0 };
+
+    void report(uint64_t trial, const Candidate& candidate, CryptoMode mode, size_t blocks,
+        const std::vector<uint8_t>& key, const std::vector<uint8_t>& IV, const char* stage) {
+        if (failures.fetch_add(1) >= 20) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(reportMutex);
+        std::cout << "FAIL trial " << trial << " " << candidate.name << " " << MODE_NAMES[static_cast<int>(mode)]
+            << " " << stage << " blocks " << blocks << " key " << toHex(key.data(), key.size())
+            << " iv " << toHex(IV.data(), IV.size()) << "\n";
+    }
+
+public:
+    Harness(const std::vector<Candidate>& candidates, ThreadPool& pool, uint64_t seed)
+        : candidates(candidates), pool(pool), seed(seed) {
+    }
+
+    void runTrial(uint64_t trial) {
+        std::mt19937_64 random(splitMix(seed ^ splitMix(trial)));
+        static const EncryptionAlgorithm ALGORITHMS[] = {
+            EncryptionAlgorithm::DES, EncryptionAlgorithm::DEAL, EncryptionAlgorithm::MARS, EncryptionAlgorithm::SERPENT };
+        EncryptionAlgorithm algorithm = ALGORITHMS[random() % 4];
+        // GCM only for the 128-bit ciphers
+        CryptoMode mode = MODES[random() % (algorithm == EncryptionAlgorithm::DES ? 7 : 8)];
+
+        size_t keyLength = algorithm == EncryptionAlgorithm::DES ? 8 : 16 + 8 * (random() % 3);
+        std::vector<uint8_t> key(keyLength), IV(16), aad;
+        for (auto& byte : key) byte = static_cast<uint8_t>(random());
+        for (auto& byte : IV) byte = static_cast<uint8_t>(random());
+        if (mode == CryptoMode::GCM) {
+            IV.resize(random() % 2 ? 12 : 1 + random() % 32);
+            aad.resize(random() % 40);
+            for (auto& byte : aad) byte = static_cast<uint8_t>(random());
+        }
+
+        std::unique_ptr<ICrypt> reference(makeCipher(algorithm, CipherBackend::Reference));
+        reference->setKey(key);
+        size_t length = static_cast<size_t>(reference->getBlockLength());
+        size_t blocks = randomBlockCount(random);
+        std::vector<uint8_t> plaintext(blocks * length);
+        for (auto& byte : plaintext) byte = static_cast<uint8_t>(random());
+
+        auto referenceKernel = getMode(mode, reference.get(), IV);
+        auto referenceTag = dynamic_cast<IAuthenticatedMode*>(referenceKernel.get());
+        if (referenceTag) {
+            referenceTag->setAAD(aad);
+        }
+        std::vector<uint8_t> expected = referenceKernel->encrypt(plaintext);
+        std::vector<uint8_t> expectedTag = referenceTag ? referenceTag->getTag() : std::vector<uint8_t>();
+        std::vector<uint8_t> out(plaintext.size());
+
+        for (const auto& candidate : candidates) {
+            if (candidate.algorithm != algorithm) {
+                continue;
+            }
+            std::unique_ptr<ICrypt> cipher(candidate.make());
+            auto kernel = getSpecializedMode(mode, cipher->setKey(key), IV);
+            if (candidate.parallel) {
+                kernel->setParallel(&pool, 3);
+            }
+            auto tag = dynamic_cast<IAuthenticatedMode*>(kernel.get());
+            if (tag) {
+                tag->setAAD(aad);
+            }
+            // two stream calls split at a random block, so the carried chain is checked too
+            size_t split = random() % (blocks + 1);
+
+            kernel->restart();
+            kernel->encryptStream(plaintext.data(), out.data(), split);
+            kernel->encryptStream(plaintext.data() + split * length, out.data() + split * length, blocks - split);
+            if (out != expected) {
+                report(trial, candidate, mode, blocks, key, IV, "encrypt");
+            }
+            else if (tag && tag->getTag() != expectedTag) {
+                report(trial, candidate, mode, blocks, key, IV, "encrypt tag");
+            }
+
+            kernel->restart();
+            kernel->decryptStream(expected.data(), out.data(), split);
+            kernel->decryptStream(expected.data() + split * length, out.data() + split * length, blocks - split);
+            if (out != plaintext) {
+                report(trial, candidate, mode, blocks, key, IV, "decrypt");
+            }
+            else if (tag && tag->getTag() != expectedTag) {
+                report(trial, candidate, mode, blocks, key, IV, "decrypt tag");
+            }
+            comparisons += 2;
+        }
+    }
+
+    uint64_t failureCount() const {
+        return failures;
+    }
+
+    uint64_t comparisonCount() const {
+        return comparisons;
+    }
+};
+
+static HarnessOptions parseOptions(int argc, char** argv) {
+    HarnessOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--kat-only") {
+            options.katOnly = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("missing value for " + arg);
+        }
+        std::string value = argv[++i];
+        if (arg == "--trials") options.trials = std::stoull(value);
+        else if (arg == "--seed") options.seed = std::stoull(value);
+        else if (arg == "--first") options.first = std::stoull(value);
+        else if (arg == "--threads") options.threads = static_cast<unsigned>(std::stoul(value));
+        else throw std::invalid_argument("unknown option " + arg);
+    }
+    return options;
+}
+
+int main(int argc, char** argv) {
+    try {
+        HarnessOptions options = parseOptions(argc, argv);
+        std::vector<Candidate> candidates = makeCandidates();
+
+        size_t katFailures = checkKnownAnswers(candidates) + checkGHash();
+        if (options.katOnly) {
+            return katFailures == 0 ? 0 : 1;
+        }
+
+        ThreadPool pool(options.threads);
+        size_t modeFailures = checkPermutations() + checkKeyCache() + checkSessions() + checkXTS(pool)
+            + checkPrefetch() + checkDecryptPaths() + checkGCM();
+        Harness harness(candidates, pool, options.seed);
+        auto start = std::chrono::steady_clock::now();
+        // many small chunks, so a run of long trials does not leave cores idle
+        const uint64_t batch = 256;
+        for (uint64_t done = 0; done < options.trials; done += batch) {
+            uint64_t count = std::min(batch, options.trials - done);
+            pool.parallelFor(static_cast<size_t>(count), 1, [&](size_t first, size_t n) {
+                for (size_t i = first; i < first + n; ++i) {
+                    harness.runTrial(options.first + done + i);
+                }
+            });
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "random trials: " << options.trials << " (seed " << options.seed << ", first "
+            << options.first << "), " << harness.comparisonCount() << " comparisons, "
+            << harness.failureCount() << " failures, " << seconds << " s on " << pool.size() << " threads\n";
+        return katFailures == 0 && modeFailures == 0 && harness.failureCount() == 0 ? 0 : 1;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "difftest: " << e.what() << "\n" << USAGE;
+        return 2;
+    }
+}
@@ -0,0 +1,242 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <deque>
+#include <memory>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+struct ReadCompletion {
+    uint64_t tag;
+    // bytes read, 0 at end of file
+    size_t result;
+};
+
+// Reads that complete asynchronously. submit() queues a read into caller-owned
+// memory, wait() blocks until one of them is done. Completions may arrive in any
+// order and may be short.
+class ChunkReader {
+public:
+    virtual void submit(uint64_t tag, uint8_t* buffer, size_t length, uint64_t offset) = 0;
+    virtual ReadCompletion wait() = 0;
+    virtual const char* name() const = 0;
+    virtual ~ChunkReader() = default;
+};
+
+// Portable fallback: the read happens inside submit().
+class BlockingReader : public ChunkReader {
+private:
+    std::ifstream file;
+    std::deque<ReadCompletion> done;
+
+public:
+    explicit BlockingReader(const std::string& path) : file(path, std::ios::binary) {
+        if (!file) {
+            throw std::runtime_error("cannot open " + path);
+        }
+    }
+
+    void submit(uint64_t tag, uint8_t* buffer, size_t length, uint64_t offset) override {
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(length));
+        if (file.bad()) {
+            throw std::runtime_error("read failed");
+        }
+        done.push_back({ tag, static_cast<size_t>(file.gcount()) });
+    }
+
+    ReadCompletion wait() override {
+        if (done.empty()) {
+            throw std::logic_error("wait() without a pending read");
+        }
+        ReadCompletion completion = done.front();
+        done.pop_front();
+        return completion;
+    }
+
+    const char* name() const override {
+        return "blocking";
+    }
+};
+
+#ifdef __linux__
+// IORING_OP_READ through the raw syscalls, so no liburing dependency.
+// Not thread-safe: one thread submits and reaps.
+class UringReader : public ChunkReader {
+private:
+    int file = -1;
+    int ring = -1;
+    void* sqMap = MAP_FAILED;
+    size_t sqMapSize = 0;
+    void* cqMap = MAP_FAILED;
+    size_t cqMapSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    unsigned unsubmitted = 0;
+    unsigned entries = 0;
+    unsigned inFlight = 0;
+
+    template<class T>
+    static T* at(void* base, unsigned offset) {
+        return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+    }
+
+    void release() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqMap != MAP_FAILED && cqMap != sqMap) munmap(cqMap, cqMapSize);
+        if (sqMap != MAP_FAILED) munmap(sqMap, sqMapSize);
+        if (ring >= 0) close(ring);
+        if (file >= 0) close(file);
+    }
+
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        int result;
+        do {
+            result = static_cast<int>(syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags, nullptr, 0));
+        } while (result < 0 && errno == EINTR);
+        return result;
+    }
+
+public:
+    UringReader(const std::string& path, unsigned depth) {
+        file = open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            throw std::runtime_error("cannot open " + path);
+        }
+
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+        if (ring < 0) {
+            release();
+            throw std::runtime_error(std::string("io_uring_setup: ") + std::strerror(errno));
+        }
+        entries = params.sq_entries;
+
+        sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+        }
+        sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+        cqMap = singleMap ? sqMap
+            : mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(
+            mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES));
+        if (sqMap == MAP_FAILED || cqMap == MAP_FAILED || sqes == MAP_FAILED) {
+            release();
+            throw std::runtime_error("cannot map io_uring rings");
+        }
+
+        sqTail = at<unsigned>(sqMap, params.sq_off.tail);
+        sqMask = *at<unsigned>(sqMap, params.sq_off.ring_mask);
+        sqArray = at<unsigned>(sqMap, params.sq_off.array);
+        cqHead = at<unsigned>(cqMap, params.cq_off.head);
+        cqTail = at<unsigned>(cqMap, params.cq_off.tail);
+        cqMask = *at<unsigned>(cqMap, params.cq_off.ring_mask);
+        cqes = at<io_uring_cqe>(cqMap, params.cq_off.cqes);
+    }
+
+    UringReader(const UringReader&) = delete;
+    UringReader& operator=(const UringReader&) = delete;
+
+    ~UringReader() {
+        // the kernel may still write into caller buffers, drain before they go away
+        try {
+            while (inFlight != 0) {
+                wait();
+            }
+        }
+        catch (...) {
+        }
+        release();
+    }
+
+    void submit(uint64_t tag, uint8_t* buffer, size_t length, uint64_t offset) override {
+        if (inFlight == entries) {
+            throw std::logic_error("io_uring queue is full");
+        }
+        if (length > UINT32_MAX) {
+            throw std::invalid_argument("io_uring read longer than 4 GiB");
+        }
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uint64_t>(buffer);
+        sqe.len = static_cast<uint32_t>(length);
+        sqe.off = offset;
+        sqe.user_data = tag;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++unsubmitted;
+        ++inFlight;
+    }
+
+    ReadCompletion wait() override {
+        if (inFlight == 0) {
+            throw std::logic_error("wait() without a pending read");
+        }
+        while (true) {
+            unsigned head = *cqHead;
+            if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                io_uring_cqe cqe = cqes[head & cqMask];
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                --inFlight;
+                if (cqe.res < 0) {
+                    throw std::runtime_error(std::string("read failed: ") + std::strerror(-cqe.res));
+                }
+                return { cqe.user_data, static_cast<size_t>(cqe.res) };
+            }
+            int submitted = enter(unsubmitted, 1, IORING_ENTER_GETEVENTS);
+            if (submitted < 0) {
+                throw std::runtime_error(std::string("io_uring_enter: ") + std::strerror(errno));
+            }
+            unsubmitted -= static_cast<unsigned>(submitted);
+        }
+    }
+
+    const char* name() const override {
+        return "io_uring";
+    }
+};
+#endif
+
+// io_uring where the kernel allows it (it is often disabled in containers),
+// blocking reads everywhere else.
+inline std::unique_ptr<ChunkReader> makeChunkReader(const std::string& path, unsigned depth) {
+#ifdef __linux__
+    try {
+        return std::make_unique<UringReader>(path, depth);
+    }
+    catch (const std::runtime_error&) {
+    }
+#endif
+    return std::make_unique<BlockingReader>(path);
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+#include "EncryptorManager.h"
+
+enum class FileCryptEngine {
+    Mmap,
+    Pipeline
+};
+
+struct FileCryptOptions {
+    StreamDirection direction = StreamDirection::Encrypt;
+    std::string input;
+    std::string output;
+    EncryptionAlgorithm algorithm = EncryptionAlgorithm::DES;
+    CryptoMode mode = CryptoMode::CBC;
+    Pudding padding = Pudding::PKCS7;
+    CipherBackend backend = CipherBackend::Optimized;
+    std::vector<uint8_t> key;
+    std::vector<uint8_t> IV;
+    unsigned threads = std::thread::hardware_concurrency();
+    FileCryptEngine engine = FileCryptEngine::Mmap;
+    // large enough for every pool thread to get DEFAULT_MIN_CHUNK_BLOCKS per update()
+    size_t chunkSize = size_t(64) << 20;
+    unsigned depth = 4;
+};
+
+inline const char* fileCryptUsage() {
+    return "usage: filecrypt encrypt|decrypt <input> <output> --key HEX [options]\n"
+        "  --algorithm des|deal|mars|serpent default des\n"
+        "  --mode ecb|cbc|pcbc|cfb|ofb|ctr|randomdelta   default cbc\n"
+        "  --padding zeros|ansix923|pkcs7|iso10126      default pkcs7\n"
+        "  --iv HEX                          required except for ecb\n"
+        "  --threads N                       default: all cores\n"
+        "  --backend reference|optimized     default optimized\n"
+        "  --engine mmap|pipeline            default mmap; pipeline streams files larger than RAM\n"
+        "  --chunk MiB                       chunk size, default 64\n"
+        "  --depth N                         pipeline buffers in flight, default 4\n";
+}
+
+inline std::vector<uint8_t> parseHex(const std::string& text) {
+    if (text.size() % 2 != 0) {
+        throw std::invalid_argument("hex string has odd length: " + text);
+    }
+    std::vector<uint8_t> bytes(text.size() / 2);
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        std::string pair = text.substr(2 * i, 2);
+        char* end = nullptr;
+        long value = std::strtol(pair.c_str(), &end, 16);
+        if (end != pair.c_str() + 2) {
+            throw std::invalid_argument("not a hex string: " + text);
+        }
+        bytes[i] = static_cast<uint8_t>(value);
+    }
+    return bytes;
+}
+
+template<class T>
+T parseChoice(const std::string& name, const std::string& value,
+    const std::vector<std::pair<const char*, T>>& choices) {
+    for (const auto& choice : choices) {
+        if (value == choice.first) {
+            return choice.second;
+        }
+    }
+    throw std::invalid_argument("unknown " + name + ": " + value);
+}
+
+inline FileCryptOptions parseCommandLine(int argc, char** argv) {
+    FileCryptOptions options;
+    std::vector<std::string> positional;
+    bool hasIV = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("missing value for " + arg);
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--algorithm") {
+            options.algorithm = parseChoice<EncryptionAlgorithm>("algorithm", value, {
+                { "des", EncryptionAlgorithm::DES },
+                { "deal", EncryptionAlgorithm::DEAL },
+                { "mars", EncryptionAlgorithm::MARS },
+                { "serpent", EncryptionAlgorithm::SERPENT } });
+        }
+        else if (arg == "--mode") {
+            options.mode = parseChoice<CryptoMode>("mode", value, {
+                { "ecb", CryptoMode::ECB }, { "cbc", CryptoMode::CBC }, { "pcbc", CryptoMode::PCBC },
+                { "cfb", CryptoMode::CFB }, { "ofb", CryptoMode::OFB }, { "ctr", CryptoMode::CTR },
+                { "randomdelta", CryptoMode::RandomDelta } });
+        }
+        else if (arg == "--padding") {
+            options.padding = parseChoice<Pudding>("padding", value, {
+                { "zeros", Pudding::Zeros }, { "ansix923", Pudding::ANSIX923 },
+                { "pkcs7", Pudding::PKCS7 }, { "iso10126", Pudding::ISO10126 } });
+        }
+        else if (arg == "--backend") {
+            options.backend = parseChoice<CipherBackend>("backend", value, {
+                { "reference", CipherBackend::Reference }, { "optimized", CipherBackend::Optimized } });
+        }
+        else if (arg == "--key") {
+            options.key = parseHex(value);
+        }
+        else if (arg == "--iv") {
+            options.IV = parseHex(value);
+            hasIV = true;
+        }
+        else if (arg == "--engine") {
+            options.engine = parseChoice<FileCryptEngine>("engine", value, {
+                { "mmap", FileCryptEngine::Mmap }, { "pipeline", FileCryptEngine::Pipeline } });
+        }
+        else if (arg == "--chunk") {
+            options.chunkSize = static_cast<size_t>(std::stoul(value)) << 20;
+        }
+        else if (arg == "--depth") {
+            options.depth = static_cast<unsigned>(std::stoul(value));
+        }
+        else if (arg == "--threads") {
+            options.threads = static_cast<unsigned>(std::stoul(value));
+        }
+        else {
+            throw std::invalid_argument("unknown option " + arg);
+        }
+    }
+
+    if (positional.size() != 3) {
+        throw std::invalid_argument("expected encrypt|decrypt, input and output");
+    }
+    options.direction = parseChoice<StreamDirection>("command", positional[0], {
+        { "encrypt", StreamDirection::Encrypt }, { "decrypt", StreamDirection::Decrypt } });
+    options.input = positional[1];
+    options.output = positional[2];
+
+    if (options.key.empty()) {
+        throw std::invalid_argument("--key is required");
+    }
+    if (!hasIV && options.mode != CryptoMode::ECB) {
+        throw std::invalid_argument("--iv is required for this mode");
+    }
+    if (options.chunkSize == 0 || options.depth == 0) {
+        throw std::invalid_argument("--chunk and --depth must be positive");
+    }
+    // one chunk is one read, and io_uring takes its length as 32 bits
+    if (options.chunkSize > UINT32_MAX) {
+        throw std::invalid_argument("--chunk must be below 4096 MiB");
+    }
+    return options;
+}
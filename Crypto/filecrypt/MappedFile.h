@@ -0,0 +1,219 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Whole file mapped read-only. Empty files are not mapped, data() is nullptr.
+class MappedInput {
+private:
+    const uint8_t* view = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int file = -1;
+#endif
+
+public:
+    explicit MappedInput(const std::string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("cannot open " + path);
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        length = static_cast<size_t>(fileSize.QuadPart);
+        if (length != 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            void* address = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            if (address == nullptr) {
+                close();
+                throw std::runtime_error("cannot map " + path);
+            }
+            view = static_cast<const uint8_t*>(address);
+        }
+#else
+        file = open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (file < 0 || fstat(file, &status) != 0) {
+            close();
+            throw std::runtime_error("cannot open " + path);
+        }
+        length = static_cast<size_t>(status.st_size);
+        if (length != 0) {
+            void* address = mmap(nullptr, length, PROT_READ, MAP_SHARED, file, 0);
+            if (address == MAP_FAILED) {
+                close();
+                throw std::runtime_error("cannot map " + path);
+            }
+            madvise(address, length, MADV_SEQUENTIAL);
+            view = static_cast<const uint8_t*>(address);
+        }
+#endif
+    }
+
+    MappedInput(const MappedInput&) = delete;
+    MappedInput& operator=(const MappedInput&) = delete;
+
+    ~MappedInput() {
+        close();
+    }
+
+    const uint8_t* data() const {
+        return view;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    void close() {
+#ifdef _WIN32
+        if (view != nullptr) {
+            UnmapViewOfFile(view);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (view != nullptr) {
+            munmap(const_cast<uint8_t*>(view), length);
+        }
+        if (file >= 0) {
+            ::close(file);
+        }
+        file = -1;
+#endif
+        view = nullptr;
+    }
+};
+
+// Output file created with a fixed capacity and mapped for writing. finish()
+// unmaps it and cuts the file to the bytes actually produced; a file that is
+// destroyed without finish() is left truncated to zero.
+class MappedOutput {
+private:
+    uint8_t* view = nullptr;
+    size_t capacity = 0;
+    std::string path;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int file = -1;
+#endif
+
+public:
+    MappedOutput(const std::string& path, size_t capacity)
+        : capacity(capacity), path(path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("cannot create " + path);
+        }
+        if (capacity != 0) {
+            ULARGE_INTEGER size;
+            size.QuadPart = capacity;
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, size.HighPart, size.LowPart, nullptr);
+            void* address = mapping ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0) : nullptr;
+            if (address == nullptr) {
+                release(0);
+                throw std::runtime_error("cannot map " + path);
+            }
+            view = static_cast<uint8_t*>(address);
+        }
+#else
+        file = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (file < 0) {
+            throw std::runtime_error("cannot create " + path);
+        }
+        if (capacity != 0) {
+            void* address = MAP_FAILED;
+            if (ftruncate(file, static_cast<off_t>(capacity)) == 0) {
+                address = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+            }
+            if (address == MAP_FAILED) {
+                release(0);
+                throw std::runtime_error("cannot map " + path);
+            }
+            view = static_cast<uint8_t*>(address);
+        }
+#endif
+    }
+
+    MappedOutput(const MappedOutput&) = delete;
+    MappedOutput& operator=(const MappedOutput&) = delete;
+
+    ~MappedOutput() {
+        release(0);
+    }
+
+    uint8_t* data() {
+        return view;
+    }
+
+    size_t size() const {
+        return capacity;
+    }
+
+    void finish(size_t length) {
+        if (!release(length)) {
+            throw std::runtime_error("cannot resize " + path);
+        }
+    }
+
+private:
+    bool release(size_t length) {
+        bool cut = true;
+#ifdef _WIN32
+        if (view != nullptr) {
+            UnmapViewOfFile(view);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        mapping = nullptr;
+        if (file != INVALID_HANDLE_VALUE) {
+            LARGE_INTEGER end;
+            end.QuadPart = static_cast<LONGLONG>(length);
+            cut = SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (view != nullptr) {
+            munmap(view, capacity);
+        }
+        if (file >= 0) {
+            cut = ftruncate(file, static_cast<off_t>(length)) == 0;
+            ::close(file);
+            file = -1;
+        }
+#endif
+        view = nullptr;
+        return cut;
+    }
+};
@@ -0,0 +1,266 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <filesystem>
+#include "ChunkReader.h"
+#include "EncryptorManager.h"
+
+struct StageStats {
+    const char* name;
+    uint64_t bytes = 0;
+    // time the stage was working, i.e. not blocked on its neighbours
+    double busySeconds = 0;
+    double stallSeconds = 0;
+
+    double megabytesPerSecond() const {
+        return busySeconds > 0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / busySeconds : 0.0;
+    }
+};
+
+struct PipelineStats {
+    StageStats read{ "read" };
+    StageStats cipher{ "cipher" };
+    StageStats write{ "write" };
+    const char* reader = "";
+    uint64_t outputBytes = 0;
+    double wallSeconds = 0;
+};
+
+// Read -> cipher -> write over a ring of `depth` chunk buffers, so memory stays at
+// about 2 * depth * chunkSize whatever the file size. Reads go through
+// ChunkReader (io_uring on Linux) and may complete out of order. The cipher stage
+// walks the chunks in file order through EncryptorManager::update(); the
+// manager's ThreadPool (setParallel) spreads each chunk over cores for the modes
+// that allow it. A writer thread drains finished chunks in order.
+class FilePipeline {
+private:
+    enum class SlotState { Free, Reading, Read, Ciphered };
+
+    struct Slot {
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+        uint64_t offset = 0;
+        size_t length = 0;
+        size_t done = 0;
+        size_t outputSize = 0;
+        SlotState state = SlotState::Free;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    EncryptorManager& manager;
+    size_t chunkSize;
+    unsigned depth;
+
+    std::vector<Slot> slots;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::exception_ptr error;
+    bool failed = false;
+
+    static double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    void fail() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+            error = std::current_exception();
+        }
+        failed = true;
+        changed.notify_all();
+    }
+
+    // Blocks until the slot reaches state; returns false if another stage failed.
+    bool waitFor(Slot& slot, SlotState state, StageStats& stats) {
+        auto start = Clock::now();
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return failed || slot.state == state; });
+        stats.stallSeconds += secondsSince(start);
+        return !failed;
+    }
+
+    void setState(Slot& slot, SlotState state) {
+        std::lock_guard<std::mutex> lock(mutex);
+        slot.state = state;
+        changed.notify_all();
+    }
+
+    void readStage(ChunkReader& reader, uint64_t fileSize, size_t chunks, StageStats& stats) {
+        size_t next = 0;
+        size_t completed = 0;
+        unsigned inFlight = 0;
+
+        while (completed < chunks) {
+            // keep every free slot busy
+            while (next < chunks) {
+                Slot& slot = slots[next % slots.size()];
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (failed) {
+                        return;
+                    }
+                    if (slot.state != SlotState::Free) {
+                        break;
+                    }
+                    slot.state = SlotState::Reading;
+                }
+                slot.offset = static_cast<uint64_t>(next) * chunkSize;
+                slot.length = static_cast<size_t>(std::min<uint64_t>(chunkSize, fileSize - slot.offset));
+                slot.done = 0;
+                if (slot.length == 0) {
+                    setState(slot, SlotState::Read);
+                    ++completed;
+                }
+                else {
+                    reader.submit(next % slots.size(), slot.input.data(), slot.length, slot.offset);
+                    ++inFlight;
+                }
+                ++next;
+            }
+
+            if (inFlight == 0) {
+                if (completed < chunks && !waitFor(slots[next % slots.size()], SlotState::Free, stats)) {
+                    return;
+                }
+                continue;
+            }
+
+            ReadCompletion completion = reader.wait();
+            --inFlight;
+            Slot& slot = slots[completion.tag];
+            if (completion.result == 0) {
+                throw std::runtime_error("input file shrank while reading");
+            }
+            slot.done += completion.result;
+            stats.bytes += completion.result;
+            if (slot.done < slot.length) {
+                reader.submit(completion.tag, slot.input.data() + slot.done,
+                    slot.length - slot.done, slot.offset + slot.done);
+                ++inFlight;
+                continue;
+            }
+            setState(slot, SlotState::Read);
+            ++completed;
+        }
+    }
+
+    void cipherStage(size_t chunks, StageStats& stats) {
+        for (size_t i = 0; i < chunks; ++i) {
+            Slot& slot = slots[i % slots.size()];
+            if (!waitFor(slot, SlotState::Read, stats)) {
+                return;
+            }
+            slot.outputSize = manager.update(slot.input.data(), slot.length, slot.output.data());
+            if (i + 1 == chunks) {
+                slot.outputSize += manager.final(slot.output.data() + slot.outputSize);
+            }
+            stats.bytes += slot.length;
+            setState(slot, SlotState::Ciphered);
+        }
+    }
+
+    void writeStage(std::ofstream& file, size_t chunks, StageStats& stats) {
+        for (size_t i = 0; i < chunks; ++i) {
+            Slot& slot = slots[i % slots.size()];
+            if (!waitFor(slot, SlotState::Ciphered, stats)) {
+                return;
+            }
+            file.write(reinterpret_cast<const char*>(slot.output.data()), static_cast<std::streamsize>(slot.outputSize));
+            if (!file) {
+                throw std::runtime_error("write failed");
+            }
+            stats.bytes += slot.outputSize;
+            setState(slot, SlotState::Free);
+        }
+        file.flush();
+        if (!file) {
+            throw std::runtime_error("write failed");
+        }
+    }
+
+    template<class F>
+    void runStage(StageStats& stats, F body) {
+        auto start = Clock::now();
+        try {
+            body();
+        }
+        catch (...) {
+            fail();
+        }
+        stats.busySeconds = secondsSince(start) - stats.stallSeconds;
+    }
+
+public:
+    FilePipeline(EncryptorManager& manager, size_t chunkSize, unsigned depth)
+        : manager(manager), chunkSize(chunkSize), depth(depth) {
+        if (chunkSize == 0 || depth == 0) {
+            throw std::invalid_argument("pipeline chunk size and depth must be positive");
+        }
+    }
+
+    PipelineStats run(const std::string& inputPath, const std::string& outputPath, StreamDirection direction) {
+        PipelineStats stats;
+        auto start = Clock::now();
+
+        uint64_t fileSize = std::filesystem::file_size(inputPath);
+        // an empty file still needs one (empty) chunk to carry final()
+        size_t chunks = static_cast<size_t>(std::max<uint64_t>((fileSize + chunkSize - 1) / chunkSize, 1));
+        unsigned ringDepth = static_cast<unsigned>(std::min<size_t>(depth, chunks));
+
+        auto reader = makeChunkReader(inputPath, ringDepth);
+        stats.reader = reader->name();
+        // written next to the target and renamed over it only once everything
+        // succeeded, so a failed run (a bad key or padding on decrypt) leaves no
+        // partial output behind
+        std::string partialPath = outputPath + ".part";
+        std::ofstream output(partialPath, std::ios::binary | std::ios::trunc);
+        if (!output) {
+            throw std::runtime_error("cannot create " + partialPath);
+        }
+
+        size_t blockLength = static_cast<size_t>(manager.getBlockLength());
+        slots.assign(ringDepth, Slot());
+        for (Slot& slot : slots) {
+            slot.input.resize(chunkSize);
+            // update() may release a held-back block, final() adds at most one more
+            slot.output.resize(chunkSize + 2 * blockLength);
+        }
+        error = nullptr;
+        failed = false;
+
+        manager.begin(direction);
+        {
+            std::thread readThread([&] {
+                runStage(stats.read, [&] { readStage(*reader, fileSize, chunks, stats.read); });
+            });
+            std::thread writeThread([&] {
+                runStage(stats.write, [&] { writeStage(output, chunks, stats.write); });
+            });
+            runStage(stats.cipher, [&] { cipherStage(chunks, stats.cipher); });
+            readThread.join();
+            writeThread.join();
+        }
+        // drains reads still in flight after a failure before their buffers go away
+        reader.reset();
+        slots.clear();
+        output.close();
+        if (error) {
+            std::error_code ignored;
+            std::filesystem::remove(partialPath, ignored);
+            std::rethrow_exception(error);
+        }
+        std::filesystem::rename(partialPath, outputPath);
+
+        stats.outputBytes = stats.write.bytes;
+        stats.wallSeconds = secondsSince(start);
+        return stats;
+    }
+};
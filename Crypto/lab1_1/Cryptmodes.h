@@ -1,8 +1,13 @@
 #pragma once
 #include"CryptoInterfaces.h"
 #include"Operations.h"
+#include"ThreadPool.h"
+#include"GHash.h"
+#include"KeystreamPrefetch.h"
 #include<memory>
 #include<vector>
+#include<algorithm>
+#include<type_traits>
 enum class CryptoMode {
     ECB,
     CBC,
@@ -10,392 +15,873 @@ enum class CryptoMode {
     CFB,
     OFB,
     CTR,
-    RandomDelta
+    RandomDelta,
+    GCM
 };
 
+constexpr size_t DEFAULT_MIN_CHUNK_BLOCKS = 4096;
+
 class AEncryptMode {
 protected:
-    ICrypt* encryptor;
     int lengthBlock;
     std::vector<uint8_t> IV;
-public:
-    AEncryptMode(ICrypt* enc, int blockLen, const std::vector<uint8_t>& iv)
-        : encryptor(enc), lengthBlock(blockLen), IV(iv) {
+    ThreadPool* pool = nullptr;
+    size_t minChunkBlocks = DEFAULT_MIN_CHUNK_BLOCKS;
+    // state carried from one stream call to the next: the feedback block for the
+    // chaining modes, the number of blocks already done for the counter-based ones
+    uint8_t chain[MAX_BLOCK_LENGTH];
+    uint64_t blockIndex = 0;
+
+    // Runs body(first, count) over [0, blocksCount), split across the pool when
+    // one is set. Only for passes where no block waits on the output of another.
+    template<class F>
+    void forEachChunk(size_t blocksCount, F body) {
+        if (blocksCount == 0) {
+            return;
+        }
+        if (pool == nullptr) {
+            body(size_t(0), blocksCount);
+            return;
+        }
+        pool->parallelFor(blocksCount, minChunkBlocks, body);
+    }
+
+    // the mode itself, behind the instrumented encryptStream/decryptStream
+    virtual void encryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) = 0;
+    virtual void decryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) = 0;
+
+    void saveChain(const uint8_t* block) {
+        std::copy(block, block + lengthBlock, chain);
     }
-    virtual std::vector<uint8_t> encrypt(std::vector<uint8_t> data) = 0;
-    virtual std::vector<uint8_t> decrypt(std::vector<uint8_t> data) = 0;
-    ~AEncryptMode() = default;
-};
 
-class CFBEncryptMode : public AEncryptMode {
 public:
-    CFBEncryptMode(ICrypt* enc, int blockLen, const std::vector<uint8_t>& iv)
-        : AEncryptMode(enc, blockLen, iv) {}
+    AEncryptMode(int blockLen, const std::vector<uint8_t>& iv)
+        : lengthBlock(blockLen), IV(iv) {
+        if (lengthBlock > MAX_BLOCK_LENGTH) {
+            throw std::invalid_argument("Block length is too large");
+        }
+        IV.resize(lengthBlock);
+        restart();
+    }
 
-    std::vector<uint8_t> encrypt(std::vector<uint8_t> data) override{
+    // Streaming interface: whole blocks only, in and out must not overlap. Every
+    // call continues the chain where the previous one stopped. Scratch memory the
+    // call takes from this thread's arena is released when it returns.
+    void encryptStream(const uint8_t* in, uint8_t* out, size_t blocksCount) {
+        ScratchScope scratch;
+        CRYPTO_STAGE(CryptoStage::Mode, blocksCount * lengthBlock, blocksCount);
+        encryptStreamBlocks(in, out, blocksCount);
+    }
+
+    void decryptStream(const uint8_t* in, uint8_t* out, size_t blocksCount) {
+        ScratchScope scratch;
+        CRYPTO_STAGE(CryptoStage::Mode, blocksCount * lengthBlock, blocksCount);
+        decryptStreamBlocks(in, out, blocksCount);
+    }
+
+    // Back to the state right after construction: chain from the IV, counter zero.
+    virtual void restart() {
+        saveChain(IV.data());
+        blockIndex = 0;
+    }
+
+    // Next messages use iv; the keyed cipher and the mode object stay as they are.
+    virtual void setIV(const std::vector<uint8_t>& iv) {
+        IV = iv;
+        IV.resize(lengthBlock);
+        restart();
+    }
+
+    // One-shot calls always start from the IV.
+    virtual std::vector<uint8_t> encrypt(std::vector<uint8_t> data) {
         std::vector<uint8_t> result(data.size());
-        std::vector<uint8_t> prev = IV;
-        for (int i = 0; i < data.size() / lengthBlock; ++i) {
-            size_t offset = i * lengthBlock;
-            std::vector<uint8_t> block(data.begin() + offset, data.begin() + offset + lengthBlock);
-            std::vector<uint8_t> encryptedBlock;
-            try {
-                 encryptedBlock = xorBits(block, encryptor->encrypt(prev));
-            }
-            catch (std::exception err) {
-                std::cerr << err.what();
-            }
-            std::copy(encryptedBlock.begin(), encryptedBlock.end(), result.begin() + offset);
-            prev = encryptedBlock;
-        }
+        restart();
+        encryptStream(data.data(), result.data(), data.size() / lengthBlock);
         return result;
     }
 
-    std::vector<uint8_t> decrypt(std::vector<uint8_t> data) override {
+    virtual std::vector<uint8_t> decrypt(std::vector<uint8_t> data) {
         std::vector<uint8_t> result(data.size());
-        std::vector<uint8_t> prev = IV;
-        for (size_t i = 0; i < data.size() / lengthBlock; ++i) {
-            size_t offset = i * lengthBlock;
-            std::vector<uint8_t> block(data.begin() + offset, data.begin() + offset + lengthBlock);
-            std::vector<uint8_t> tmp = block;
-            std::vector<uint8_t> decryptedBlock = xorBits(block, encryptor->encrypt(prev));
-            std::copy(decryptedBlock.begin(), decryptedBlock.end(), result.begin() + offset);
-            prev = tmp;
-        }
+        restart();
+        decryptStream(data.data(), result.data(), data.size() / lengthBlock);
         return result;
     }
 
+    // nullptr switches back to the serial path
+    void setParallel(ThreadPool* threadPool, size_t minChunk = DEFAULT_MIN_CHUNK_BLOCKS) {
+        pool = threadPool;
+        minChunkBlocks = minChunk;
+    }
+
+    // OFB and CTR: a background thread keeps up to blocks of keystream ready so
+    // that the next blocks are only XORed; 0 turns it off. Output is
+    // byte-identical either way.
+    virtual void setPrefetch(size_t blocks) {
+        if (blocks != 0) {
+            throw std::invalid_argument("Only OFB and CTR keystream can be prefetched");
+        }
+    }
+
+    virtual KeystreamStats getPrefetchStats() {
+        return {};
+    }
+
+    int getBlockLength() const {
+        return lengthBlock;
+    }
+
+    virtual ~AEncryptMode() = default;
 };
 
-class ECBEncryptMode : public AEncryptMode {
+// The block cipher calls of a mode over engine type Cipher, counted as their own
+// stage. For a concrete engine they bind at compile time, so the engine's rounds
+// can be inlined into the mode loops; Cipher = ICrypt keeps virtual dispatch.
+template<class Cipher>
+class CipherMode : public AEncryptMode {
+protected:
+    Cipher* encryptor;
+
+    void cipherEncrypt(const uint8_t* in, uint8_t* out) {
+        CRYPTO_STAGE(CryptoStage::Cipher, lengthBlock, 1);
+        if constexpr (std::is_abstract_v<Cipher>)
+            encryptor->encryptBlock(in, out);
+        else
+            encryptor->Cipher::encryptBlock(in, out);
+    }
+
+    // for code that runs apart from the mode object, like the prefetch thread
+    static void encryptWith(Cipher* engine, [[maybe_unused]] int blockLen, const uint8_t* in, uint8_t* out, size_t blocksCount) {
+        CRYPTO_STAGE(CryptoStage::Cipher, blocksCount * blockLen, blocksCount);
+        if constexpr (std::is_abstract_v<Cipher>)
+            engine->encryptBlocks(in, out, blocksCount);
+        else
+            engine->Cipher::encryptBlocks(in, out, blocksCount);
+    }
+
+    void cipherEncrypt(const uint8_t* in, uint8_t* out, size_t blocksCount) {
+        encryptWith(encryptor, lengthBlock, in, out, blocksCount);
+    }
+
+    void cipherDecrypt(const uint8_t* in, uint8_t* out) {
+        CRYPTO_STAGE(CryptoStage::Cipher, lengthBlock, 1);
+        if constexpr (std::is_abstract_v<Cipher>)
+            encryptor->decryptBlock(in, out);
+        else
+            encryptor->Cipher::decryptBlock(in, out);
+    }
+
+    void cipherDecrypt(const uint8_t* in, uint8_t* out, size_t blocksCount) {
+        CRYPTO_STAGE(CryptoStage::Cipher, blocksCount * lengthBlock, blocksCount);
+        if constexpr (std::is_abstract_v<Cipher>)
+            encryptor->decryptBlocks(in, out, blocksCount);
+        else
+            encryptor->Cipher::decryptBlocks(in, out, blocksCount);
+    }
+
 public:
-    ECBEncryptMode(ICrypt* enc, int blockLen, std::vector<uint8_t>&)
-        : AEncryptMode(enc, blockLen, {}) {
+    CipherMode(Cipher* enc, int blockLen, const std::vector<uint8_t>& iv)
+        : AEncryptMode(blockLen, iv), encryptor(enc) {
     }
+};
 
-    std::vector<uint8_t> encrypt(std::vector<uint8_t> data) override {
-        std::vector<uint8_t> result(data.size());
-        for (int i = 0; i < data.size() / lengthBlock; ++i) {
-            size_t offset = i * lengthBlock;
-            std::vector<uint8_t> block(data.begin() + offset, data.begin() + offset + lengthBlock);
-            std::vector<uint8_t> encryptedBlock;
-            
-            encryptedBlock = encryptor->encrypt(block);
-            
-            std::copy(encryptedBlock.begin(), encryptedBlock.end(), result.begin() + offset);
+// Modes whose keystream depends only on the key, the IV and the block number
+// (OFB, CTR), so it can be made ahead of the data by a KeystreamPrefetcher.
+template<class Cipher>
+class KeystreamMode : public CipherMode<Cipher> {
+    using Base = CipherMode<Cipher>;
+
+    bool chainedKeystream;
+    std::unique_ptr<KeystreamPrefetcher> prefetcher;
+
+protected:
+    using Base::lengthBlock;
+    using Base::blockIndex;
+
+    // the feedback at blockIndex: the chain for OFB, the IV for CTR
+    virtual uint8_t* keystreamFeedback() = 0;
+    // captures the engine only: the thread may still run while the mode is destroyed
+    virtual KeystreamPrefetcher::Generator keystreamGenerator() = 0;
+
+    // XORs the keystream that is ready for the blocks from blockIndex on and
+    // moves in, out and blockIndex past them; returns how many blocks it took.
+    size_t applyPrefetched(const uint8_t*& in, uint8_t*& out, size_t blocksCount) {
+        if (prefetcher == nullptr) {
+            return 0;
         }
-        return result;
+        size_t ready = prefetcher->apply(blockIndex, keystreamFeedback(), in, out, blocksCount);
+        blockIndex += ready;
+        in += ready * lengthBlock;
+        out += ready * lengthBlock;
+        return ready;
     }
 
-    std::vector<uint8_t> decrypt(std::vector<uint8_t> data)override {
-        std::vector<uint8_t> result(data.size());
-        for (size_t i = 0; i < data.size() / lengthBlock; ++i) {
-            size_t offset = i * lengthBlock;
-            std::vector<uint8_t> block(data.begin() + offset, data.begin() + offset + lengthBlock);
-            std::vector<uint8_t> decryptedBlock = encryptor->decrypt(block);
-            std::copy(decryptedBlock.begin(), decryptedBlock.end(), result.begin() + offset);
+    // blocksCount blocks up to blockIndex were generated inline; the thread
+    // continues after them
+    void skipPrefetched(size_t blocksCount) {
+        if (prefetcher != nullptr && blocksCount != 0) {
+            prefetcher->addInline(blocksCount);
+            prefetcher->reset(blockIndex, keystreamFeedback());
         }
-        return result;
     }
 
-};
-
-class CBCEncryptMode : public AEncryptMode {
 public:
-    CBCEncryptMode(ICrypt* enc, int blockLen, const std::vector<uint8_t>& iv)
-        : AEncryptMode(enc, blockLen, iv) {
+    KeystreamMode(Cipher* enc, int blockLen, const std::vector<uint8_t>& iv, bool chained)
+        : Base(enc, blockLen, iv), chainedKeystream(chained) {
     }
 
-
-private:
-    void decryptProcess(const std::vector<uint8_t>& input, std::vector<uint8_t>& output, size_t i) {
-        std::vector<uint8_t> prev;
-        if (i == 0) {
-            prev = IV;
+    void restart() override {
+        AEncryptMode::restart();
+        if (prefetcher != nullptr) {
+            prefetcher->reset(blockIndex, keystreamFeedback());
         }
-        else {
-            size_t prevOffset = (i - 1) * lengthBlock;
-            prev.assign(input.begin() + prevOffset, input.begin() + prevOffset + lengthBlock);
+    }
+
+    void setPrefetch(size_t blocks) override {
+        prefetcher.reset();
+        if (blocks != 0) {
+            prefetcher = std::make_unique<KeystreamPrefetcher>(lengthBlock, blocks, chainedKeystream, keystreamGenerator());
+            prefetcher->reset(blockIndex, keystreamFeedback());
         }
+    }
 
-        size_t offset = i * lengthBlock;
-        std::vector<uint8_t> block(input.begin() + offset, input.begin() + offset + lengthBlock);
-        std::vector<uint8_t> decrypted = encryptor->decrypt(block);
-        std::vector<uint8_t> xored = xorBits(decrypted, prev);
-        std::copy(xored.begin(), xored.end(), output.begin() + offset);
+    KeystreamStats getPrefetchStats() override {
+        return prefetcher != nullptr ? prefetcher->getStats() : KeystreamStats{};
     }
+};
 
-public:
+template<class Cipher>
+class CFBEncryptMode : public CipherMode<Cipher> {
+    using Base = CipherMode<Cipher>;
+    using Base::lengthBlock;
+    using Base::chain;
+    using Base::cipherEncrypt;
+    using Base::saveChain;
+    using Base::forEachChunk;
 
-    std::vector<uint8_t> encrypt(std::vector<uint8_t> data) override {
-        std::vector<uint8_t> result(data.size());
-        std::vector<uint8_t> prev = IV;
-        size_t blocksCount = data.size() / lengthBlock;
+public:
+    CFBEncryptMode(Cipher* enc, int blockLen, const std::vector<uint8_t>& iv)
+        : Base(enc, blockLen, iv) {}
 
+protected:
+    void encryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        uint8_t keystream[MAX_BLOCK_LENGTH];
         for (size_t i = 0; i < blocksCount; ++i) {
             size_t offset = i * lengthBlock;
-            std::vector<uint8_t> block(data.begin() + offset, data.begin() + offset + lengthBlock);
-            std::vector<uint8_t> xored = xorBits(block, prev);
-            std::vector<uint8_t> encryptedBlock = encryptor->encrypt(xored);
-            std::copy(encryptedBlock.begin(), encryptedBlock.end(), result.begin() + offset);
-            prev = encryptedBlock;
+            cipherEncrypt(chain, keystream);
+            xorBits(in + offset, keystream, out + offset, lengthBlock);
+            saveChain(out + offset);
         }
+    }
 
-        return result;
+    void decryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        forEachChunk(blocksCount, [&](size_t first, size_t count) {
+            decryptProcess(in, out, first, count);
+        });
+        if (blocksCount != 0) {
+            saveChain(in + (blocksCount - 1) * lengthBlock);
+        }
     }
-    std::vector<uint8_t> decrypt(std::vector<uint8_t> data) override {
-        std::vector<uint8_t> result(data.size());
-        size_t blocksCount = data.size() / lengthBlock;
 
-        for (size_t i = 0; i < blocksCount; ++i) {
-            decryptProcess(data, result, i);
+private:
+    // keystream of block i is E(C[i-1]), so decryption needs only the ciphertext
+    void decryptProcess(const uint8_t* input, uint8_t* output, size_t first, size_t count) {
+        size_t offset = first * lengthBlock;
+        uint8_t* keystream = output + offset;
+
+        if (first == 0) {
+            cipherEncrypt(chain, keystream);
+            cipherEncrypt(input, keystream + lengthBlock, count - 1);
+        }
+        else {
+            cipherEncrypt(input + offset - lengthBlock, keystream, count);
         }
+        xorBits(input + offset, keystream, keystream, count * lengthBlock);
+    }
 
-        return result;
+};
+
+template<class Cipher>
+class ECBEncryptMode : public CipherMode<Cipher> {
+    using Base = CipherMode<Cipher>;
+    using Base::lengthBlock;
+    using Base::cipherEncrypt;
+    using Base::cipherDecrypt;
+    using Base::forEachChunk;
+
+public:
+    ECBEncryptMode(Cipher* enc, int blockLen, std::vector<uint8_t>&)
+        : Base(enc, blockLen, {}) {
+    }
+
+protected:
+    void encryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        forEachChunk(blocksCount, [&](size_t first, size_t count) {
+            size_t offset = first * lengthBlock;
+            cipherEncrypt(in + offset, out + offset, count);
+        });
+    }
+
+    void decryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        forEachChunk(blocksCount, [&](size_t first, size_t count) {
+            size_t offset = first * lengthBlock;
+            cipherDecrypt(in + offset, out + offset, count);
+        });
     }
+
 };
 
-class PCBCEncryptMode : public AEncryptMode {
+template<class Cipher>
+class CBCEncryptMode : public CipherMode<Cipher> {
+    using Base = CipherMode<Cipher>;
+    using Base::lengthBlock;
+    using Base::chain;
+    using Base::cipherEncrypt;
+    using Base::cipherDecrypt;
+    using Base::saveChain;
+    using Base::forEachChunk;
+
 public:
-    PCBCEncryptMode(ICrypt* enc, int blockLen, const std::vector<uint8_t>& iv)
-        : AEncryptMode(enc, blockLen, iv) {
+    CBCEncryptMode(Cipher* enc, int blockLen, const std::vector<uint8_t>& iv)
+        : Base(enc, blockLen, iv) {
     }
 
-    std::vector<uint8_t> encrypt(std::vector<uint8_t> data) override {
-        std::vector<uint8_t> result(data.size());
-        std::vector<uint8_t> xorBlock = IV;
 
-        for (size_t i = 0; i < data.size() / lengthBlock; ++i) {
-            size_t offset = i * lengthBlock;
+private:
+    void decryptProcess(const uint8_t* input, uint8_t* output, size_t first, size_t count) {
+        cipherDecrypt(input + first * lengthBlock, output + first * lengthBlock, count);
 
-            std::vector<uint8_t> block(data.begin() + offset, data.begin() + offset + lengthBlock);
-            std::vector<uint8_t> xorInput = xorBits(block, xorBlock);
-            std::vector<uint8_t> encryptedBlock;
+        for (size_t i = first; i < first + count; ++i) {
+            const uint8_t* prev = (i == 0) ? chain : input + (i - 1) * lengthBlock;
+            size_t offset = i * lengthBlock;
+            xorBits(output + offset, prev, output + offset, lengthBlock);
+        }
+    }
 
-            try {
-                encryptedBlock = encryptor->encrypt(xorInput);
-            }
-            catch (const std::exception& err) {
-                std::cerr << err.what() << std::endl;
-                continue;
-            }
+protected:
 
-            std::copy(encryptedBlock.begin(), encryptedBlock.end(), result.begin() + offset);
-            xorBlock = xorBits(encryptedBlock, block);
+    void encryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        for (size_t i = 0; i < blocksCount; ++i) {
+            size_t offset = i * lengthBlock;
+            xorBits(in + offset, chain, out + offset, lengthBlock);
+            cipherEncrypt(out + offset, out + offset);
+            saveChain(out + offset);
         }
+    }
 
-        return result;
+    void decryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        forEachChunk(blocksCount, [&](size_t first, size_t count) {
+            decryptProcess(in, out, first, count);
+        });
+        if (blocksCount != 0) {
+            saveChain(in + (blocksCount - 1) * lengthBlock);
+        }
     }
+};
 
-    std::vector<uint8_t> decrypt(std::vector<uint8_t> data) override {
-        std::vector<uint8_t> result(data.size());
-        std::vector<uint8_t> xorBlock = IV;
+template<class Cipher>
+class PCBCEncryptMode : public CipherMode<Cipher> {
+    using Base = CipherMode<Cipher>;
+    using Base::lengthBlock;
+    using Base::chain;
+    using Base::cipherEncrypt;
+    using Base::cipherDecrypt;
+
+public:
+    PCBCEncryptMode(Cipher* enc, int blockLen, const std::vector<uint8_t>& iv)
+        : Base(enc, blockLen, iv) {
+    }
 
-        for (size_t i = 0; i < data.size() / lengthBlock; ++i) {
+protected:
+    void encryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        for (size_t i = 0; i < blocksCount; ++i) {
             size_t offset = i * lengthBlock;
+            const uint8_t* block = in + offset;
+            uint8_t* encryptedBlock = out + offset;
 
-            std::vector<uint8_t> block(data.begin() + offset, data.begin() + offset + lengthBlock);
-            std::vector<uint8_t> decryptedBlock;
+            xorBits(block, chain, encryptedBlock, lengthBlock);
+            cipherEncrypt(encryptedBlock, encryptedBlock);
+            xorBits(encryptedBlock, block, chain, lengthBlock);
+        }
+    }
 
-            try {
-                decryptedBlock = encryptor->decrypt(block);
-            }
-            catch (const std::exception& err) {
-                std::cerr << err.what() << std::endl;
-                continue;
-            }
+    void decryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        for (size_t i = 0; i < blocksCount; ++i) {
+            size_t offset = i * lengthBlock;
+            const uint8_t* block = in + offset;
+            uint8_t* plainBlock = out + offset;
 
-            std::vector<uint8_t> plainBlock = xorBits(decryptedBlock, xorBlock);
-            std::copy(plainBlock.begin(), plainBlock.end(), result.begin() + offset);
-            xorBlock = xorBits(block, plainBlock);
+            cipherDecrypt(block, plainBlock);
+            xorBits(plainBlock, chain, plainBlock, lengthBlock);
+            xorBits(block, plainBlock, chain, lengthBlock);
         }
-
-        return result;
     }
 };
 
-class CTREncryptMode : public AEncryptMode {
+template<class Cipher>
+class CTREncryptMode : public KeystreamMode<Cipher> {
+    using Base = KeystreamMode<Cipher>;
+    using Base::lengthBlock;
+    using Base::IV;
+    using Base::blockIndex;
+    using Base::encryptor;
+    using Base::cipherEncrypt;
+    using Base::forEachChunk;
+    using Base::applyPrefetched;
+    using Base::skipPrefetched;
+
 public:
-    CTREncryptMode(ICrypt* enc, int blockLen, const std::vector<uint8_t>& iv)
-        : AEncryptMode(enc, blockLen, iv) {
+    CTREncryptMode(Cipher* enc, int blockLen, const std::vector<uint8_t>& iv)
+        : Base(enc, blockLen, iv, false) {
     }
 
 private:
-    void process(const std::vector<uint8_t>& input, std::vector<uint8_t>& output, int i) {
-        size_t offset = i * lengthBlock;
-        std::vector<uint8_t> block(input.begin() + offset, input.begin() + offset + lengthBlock);
-
-        std::vector<uint8_t> processBlock(lengthBlock);
+    //     counter, counter + 1, ...  out
+    static void writeCounters(const uint8_t* nonce, int lengthBlock, uint64_t counter, uint8_t* out, size_t count) {
         int lengthHalf = lengthBlock / 2;
 
-        //    IV
-        std::copy(IV.begin(), IV.begin() + lengthHalf, processBlock.begin());
+        for (size_t i = 0; i < count; ++i, ++counter) {
+            uint8_t* processBlock = out + i * lengthBlock;
 
-        //     (big-endian)
-        for (int j = 0; j < lengthHalf; ++j) {
-            processBlock[lengthHalf + j] = static_cast<uint8_t>((i >> ((lengthHalf - 1 - j) * 8)) & 0xFF);
-        }
+            //    IV
+            std::copy(nonce, nonce + lengthHalf, processBlock);
 
-        //    IV  
-        std::vector<uint8_t> encryptedCounter;
-        try {
-            encryptedCounter = encryptor->encrypt(processBlock);
-        }
-        catch (const std::exception& err) {
-            std::cerr << err.what() << std::endl;
-            return;
+            //     (big-endian)
+            for (int j = 0; j < lengthHalf; ++j) {
+                int shift = (lengthHalf - 1 - j) * 8;
+                processBlock[lengthHalf + j] = shift < 64 ? static_cast<uint8_t>((counter >> shift) & 0xFF) : 0;
+            }
         }
+    }
 
-        // XOR   
-        std::vector<uint8_t> processedBlock = xorBits(block, encryptedCounter);
+    void process(const uint8_t* input, uint8_t* output, size_t first, size_t count) {
+        uint8_t* keystream = output + first * lengthBlock;
+        writeCounters(IV.data(), lengthBlock, blockIndex + first, keystream, count);
 
-        //     
-        std::copy(processedBlock.begin(), processedBlock.end(), output.begin() + offset);
+        //    IV  
+        cipherEncrypt(keystream, keystream, count);
+
+        // XOR   
+        xorBits(input + first * lengthBlock, keystream, keystream, count * lengthBlock);
     }
 
-public:
-    std::vector<uint8_t> encrypt(std::vector<uint8_t> data) override {
-        std::vector<uint8_t> result(data.size());
-        size_t blocksCount = data.size() / lengthBlock;
+protected:
+    uint8_t* keystreamFeedback() override {
+        return IV.data();
+    }
 
-        for (size_t i = 0; i < blocksCount; ++i) {
-            process(data, result, static_cast<int>(i));
-        }
+    KeystreamPrefetcher::Generator keystreamGenerator() override {
+        Cipher* engine = encryptor;
+        int length = lengthBlock;
+        return [engine, length](uint64_t position, uint8_t* nonce, uint8_t* out, size_t count) {
+            writeCounters(nonce, length, position, out, count);
+            Base::encryptWith(engine, length, out, out, count);
+        };
+    }
 
-        return result;
+    void encryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        blocksCount -= applyPrefetched(in, out, blocksCount);
+        forEachChunk(blocksCount, [&](size_t first, size_t count) {
+            process(in, out, first, count);
+        });
+        blockIndex += blocksCount;
+        skipPrefetched(blocksCount);
     }
 
-    std::vector<uint8_t> decrypt( std::vector<uint8_t> data) override {
+    void decryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
         //  CTR     
-        return encrypt(data);
+        encryptStreamBlocks(in, out, blocksCount);
     }
 };
 
-class RandomDeltaEncryptMode : public AEncryptMode {
+template<class Cipher>
+class RandomDeltaEncryptMode : public CipherMode<Cipher> {
+    using Base = CipherMode<Cipher>;
+    using Base::lengthBlock;
+    using Base::IV;
+    using Base::blockIndex;
+    using Base::cipherEncrypt;
+    using Base::cipherDecrypt;
+    using Base::forEachChunk;
+
 private:
     uint64_t init;
     uint64_t delta = 1;
 
-    void processEncrypt(const std::vector<uint8_t>& input, std::vector<uint8_t>& output, int i) {
+    void xorDelta(uint8_t* block, uint64_t i) {
         uint64_t initCurr = init + delta * i;
-        size_t offset = i * lengthBlock;
-
-        std::vector<uint8_t> block(input.begin() + offset, input.begin() + offset + lengthBlock);
+        uint8_t initCurrBytes[8];
+        uint64ToBytes(initCurr, initCurrBytes);
+        xorBits(block, initCurrBytes, block, std::min(8, lengthBlock));
+    }
 
-        std::vector<uint8_t> initCurrBytes = uint64ToBytes(initCurr);
+    void processEncrypt(const uint8_t* input, uint8_t* output, size_t first, size_t count) {
+        size_t offset = first * lengthBlock;
+        uint8_t* blocks = output + offset;
 
         // XOR  8    initCurrBytes
-        for (size_t j = 0; j < 8 && j < block.size(); ++j) {
-            block[j] ^= initCurrBytes[j];
+        std::copy(input + offset, input + offset + count * lengthBlock, blocks);
+        for (size_t i = first; i < first + count; ++i) {
+            xorDelta(output + i * lengthBlock, blockIndex + i);
         }
 
-        std::vector<uint8_t> encryptedBlock = encryptor->encrypt(block);
-
-        std::copy(encryptedBlock.begin(), encryptedBlock.end(), output.begin() + offset);
+        cipherEncrypt(blocks, blocks, count);
     }
 
-    void processDecrypt(const std::vector<uint8_t>& input, std::vector<uint8_t>& output, int i) {
-        uint64_t initCurr = init + delta * i;
-        size_t offset = i * lengthBlock;
-
-        std::vector<uint8_t> block(input.begin() + offset, input.begin() + offset + lengthBlock);
-
-        std::vector<uint8_t> decryptedBlock = encryptor->decrypt(block);
-
-        std::vector<uint8_t> initCurrBytes = uint64ToBytes(initCurr);
+    void processDecrypt(const uint8_t* input, uint8_t* output, size_t first, size_t count) {
+        size_t offset = first * lengthBlock;
+        cipherDecrypt(input + offset, output + offset, count);
 
         // XOR  8   initCurrBytes
-        for (size_t j = 0; j < 8 && j < decryptedBlock.size(); ++j) {
-            decryptedBlock[j] ^= initCurrBytes[j];
+        for (size_t i = first; i < first + count; ++i) {
+            xorDelta(output + i * lengthBlock, blockIndex + i);
         }
-
-        std::copy(decryptedBlock.begin(), decryptedBlock.end(), output.begin() + offset);
     }
 
 public:
-    RandomDeltaEncryptMode(ICrypt* enc, int blockLen, const std::vector<uint8_t>& iv)
-        : AEncryptMode(enc, blockLen, iv)
+    RandomDeltaEncryptMode(Cipher* enc, int blockLen, const std::vector<uint8_t>& iv)
+        : Base(enc, blockLen, iv)
     {
-        init = bytesToUint64({ iv.begin(), iv.begin() + 8 });
+        init = bytesToUint64(IV.data());
+    }
+
+    void setIV(const std::vector<uint8_t>& iv) override {
+        AEncryptMode::setIV(iv);
+        init = bytesToUint64(IV.data());
+    }
+
+protected:
+    void encryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        forEachChunk(blocksCount, [&](size_t first, size_t count) {
+            processEncrypt(in, out, first, count);
+        });
+        blockIndex += blocksCount;
     }
 
+    void decryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        forEachChunk(blocksCount, [&](size_t first, size_t count) {
+            processDecrypt(in, out, first, count);
+        });
+        blockIndex += blocksCount;
+    }
+
+public:
     std::vector<uint8_t> encrypt(const std::vector<uint8_t> data) override {
         if (data.size() % lengthBlock != 0) {
             throw std::invalid_argument("Data size must be multiple of block length");
         }
-        std::vector<uint8_t> result(data.size());
-
-        size_t blocksCount = data.size() / lengthBlock;
-        for (int i = 0; i < static_cast<int>(blocksCount); ++i) {
-            processEncrypt(data, result, i);
-        }
-        return result;
+        return AEncryptMode::encrypt(data);
     }
 
     std::vector<uint8_t> decrypt(const std::vector<uint8_t> data) override {
         if (data.size() % lengthBlock != 0) {
             throw std::invalid_argument("Data size must be multiple of block length");
         }
-        std::vector<uint8_t> result(data.size());
-
-        size_t blocksCount = data.size() / lengthBlock;
-        for (int i = 0; i < static_cast<int>(blocksCount); ++i) {
-            processDecrypt(data, result, i);
-        }
-        return result;
+        return AEncryptMode::decrypt(data);
     }
 };
 
 
-class OFBEncryptMode : public AEncryptMode {
+template<class Cipher>
+class OFBEncryptMode : public KeystreamMode<Cipher> {
+    using Base = KeystreamMode<Cipher>;
+    using Base::lengthBlock;
+    using Base::chain;
+    using Base::blockIndex;
+    using Base::encryptor;
+    using Base::cipherEncrypt;
+    using Base::applyPrefetched;
+    using Base::skipPrefetched;
+
 public:
-    OFBEncryptMode(ICrypt* enc, int blockLen, const std::vector<uint8_t>& iv)
-        : AEncryptMode(enc, blockLen, iv) {
+    OFBEncryptMode(Cipher* enc, int blockLen, const std::vector<uint8_t>& iv)
+        : Base(enc, blockLen, iv, true) {
     }
 
-    std::vector<uint8_t> encrypt(std::vector<uint8_t> data) override {
-        std::vector<uint8_t> result(data.size());
-        std::vector<uint8_t> prev = IV;
-        for (size_t i = 0; i < data.size() / lengthBlock; ++i) {
+protected:
+    uint8_t* keystreamFeedback() override {
+        return chain;
+    }
+
+    KeystreamPrefetcher::Generator keystreamGenerator() override {
+        Cipher* engine = encryptor;
+        int length = lengthBlock;
+        return [engine, length](uint64_t, uint8_t* feedback, uint8_t* out, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                uint8_t* block = out + i * length;
+                Base::encryptWith(engine, length, feedback, block, 1);
+                std::copy(block, block + length, feedback);
+            }
+        };
+    }
+
+    void encryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        blocksCount -= applyPrefetched(in, out, blocksCount);
+        for (size_t i = 0; i < blocksCount; ++i) {
             size_t startIndex = i * lengthBlock;
-            std::vector<uint8_t> block(data.begin() + startIndex, data.begin() + startIndex + lengthBlock);
-            std::vector<uint8_t> encryptedPart = encryptor->encrypt(prev);
-            std::vector<uint8_t> encryptedBlock = xorBits(block, encryptedPart);
-            std::copy(encryptedBlock.begin(), encryptedBlock.end(), result.begin() + startIndex);
-            prev = encryptedPart;
+            cipherEncrypt(chain, chain);
+            xorBits(in + startIndex, chain, out + startIndex, lengthBlock);
         }
-        return result;
+        blockIndex += blocksCount;
+        skipPrefetched(blocksCount);
     }
 
-    std::vector<uint8_t> decrypt(std::vector<uint8_t> data) override {
+    void decryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
         //  OFB     
-        return encrypt(data);
+        encryptStreamBlocks(in, out, blocksCount);
     }
 };
 
 
+// Modes that authenticate as well as encrypt.
+class IAuthenticatedMode {
+public:
+    // Authenticated but not encrypted; used from the next restart() on.
+    virtual void setAAD(const std::vector<uint8_t>& aad) = 0;
+
+    // Tag over the AAD and every block processed since restart().
+    virtual std::vector<uint8_t> getTag() = 0;
+
+    // Ends the message with a partial block of size bytes (0 < size < block
+    // length), without padding: out gets exactly size bytes. No more blocks
+    // until restart().
+    virtual void encryptTail(const uint8_t* in, uint8_t* out, size_t size) = 0;
+    virtual void decryptTail(const uint8_t* in, uint8_t* out, size_t size) = 0;
+
+    // Encryption throws until setIV() brings a nonce; decryption is unaffected.
+    virtual void discardNonce() = 0;
+
+    virtual ~IAuthenticatedMode() = default;
+};
+
+// GCM (NIST SP 800-38D) over a 128-bit cipher: CTR with a 32-bit big-endian
+// counter from J0 + 1, and GHASH over the AAD and the ciphertext. A message may
+// end in a partial block, which takes only as many keystream bytes as it has, so
+// the ciphertext is as long as the plaintext. A 12-byte IV is the nonce as is,
+// other lengths go through GHASH first. A nonce encrypts one message only: a
+// second encryption throws until setIV(), since two messages under one (key,
+// nonce) give away the keystream and the GHASH key. Serially
+// every slice of INTERLEAVE_BLOCKS is hashed right after its keystream, while it
+// is still in L1; with a pool the keystream is split and GHASH runs after it.
+template<class Cipher>
+class GCMEncryptMode : public CipherMode<Cipher>, public IAuthenticatedMode {
+    using Base = CipherMode<Cipher>;
+    using Base::lengthBlock;
+    using Base::blockIndex;
+    using Base::pool;
+    using Base::cipherEncrypt;
+    using Base::forEachChunk;
+
+private:
+    static constexpr size_t INTERLEAVE_BLOCKS = 64;
+    static constexpr uint64_t MAX_BLOCKS = (uint64_t(1) << 32) - 2;
+
+    std::vector<uint8_t> nonce;
+    std::vector<uint8_t> aad;
+    GHash ghash;
+    uint8_t counter0[16];
+    // length of the partial block that ended the message, 0 while it goes on
+    size_t tailBytes = 0;
+    // set by the first encryption under the nonce, cleared by setIV() only
+    bool nonceUsed = false;
+    // the message since restart() is the one that used it
+    bool messageOwnsNonce = false;
+
+    void claimNonce() {
+        if (messageOwnsNonce) {
+            return;
+        }
+        if (nonceUsed) {
+            throw std::logic_error("GCM nonce already used for encryption: setIV() a fresh one first");
+        }
+        nonceUsed = messageOwnsNonce = true;
+    }
+
+    void process(const uint8_t* input, uint8_t* output, size_t first, size_t count) {
+        uint8_t* keystream = output + first * 16;
+        uint32_t base = static_cast<uint32_t>(bytesToUint64(counter0 + 8));
+        for (size_t i = 0; i < count; ++i) {
+            uint8_t* block = keystream + i * 16;
+            uint32_t counter = base + static_cast<uint32_t>(blockIndex + first + i + 1);
+            std::copy(counter0, counter0 + 12, block);
+            for (int j = 0; j < 4; ++j) {
+                block[12 + j] = static_cast<uint8_t>(counter >> (24 - 8 * j));
+            }
+        }
+        cipherEncrypt(keystream, keystream, count);
+        xorBits(input + first * 16, keystream, keystream, count * 16);
+    }
+
+    void hash(const uint8_t* ciphertext, size_t blocksCount) {
+        CRYPTO_STAGE(CryptoStage::Authentication, blocksCount * 16, blocksCount);
+        ghash.update(ciphertext, blocksCount);
+    }
+
+    void checkLength(size_t blocksCount) {
+        if (tailBytes != 0) {
+            throw std::logic_error("GCM message already ended with a partial block");
+        }
+        if (blocksCount > MAX_BLOCKS - blockIndex) {
+            throw std::invalid_argument("GCM message is too long");
+        }
+    }
+
+    void processTail(const uint8_t* in, uint8_t* out, size_t size, bool encrypting) {
+        if (size == 0 || size >= 16) {
+            throw std::invalid_argument("GCM tail must be shorter than a block");
+        }
+        checkLength(1);
+        if (encrypting) {
+            claimNonce();
+        }
+        CRYPTO_STAGE(CryptoStage::Mode, size, 1);
+        uint8_t block[16] = {};
+        uint8_t result[16];
+        std::copy(in, in + size, block);
+        process(block, result, 0, 1);
+        std::copy(result, result + size, out);
+
+        CRYPTO_STAGE(CryptoStage::Authentication, size, 1);
+        ghash.updatePadded(encrypting ? out : block, size);
+        tailBytes = size;
+    }
+
+    // with a pool the whole call is one slice, so the keystream can spread over it
+    size_t sliceBlocks(size_t blocksCount) const {
+        return pool == nullptr ? INTERLEAVE_BLOCKS : std::max<size_t>(blocksCount, 1);
+    }
+
+protected:
+    void encryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        checkLength(blocksCount);
+        claimNonce();
+        size_t step = sliceBlocks(blocksCount);
+        for (size_t done = 0; done < blocksCount; done += step) {
+            size_t count = std::min(step, blocksCount - done);
+            forEachChunk(count, [&](size_t first, size_t n) {
+                process(in, out, done + first, n);
+            });
+            hash(out + done * 16, count);
+        }
+        blockIndex += blocksCount;
+    }
+
+    void decryptStreamBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount) override {
+        checkLength(blocksCount);
+        size_t step = sliceBlocks(blocksCount);
+        for (size_t done = 0; done < blocksCount; done += step) {
+            size_t count = std::min(step, blocksCount - done);
+            hash(in + done * 16, count);
+            forEachChunk(count, [&](size_t first, size_t n) {
+                process(in, out, done + first, n);
+            });
+        }
+        blockIndex += blocksCount;
+    }
+
+public:
+    GCMEncryptMode(Cipher* enc, int blockLen, const std::vector<uint8_t>& iv)
+        : Base(enc, blockLen, iv), nonce(iv) {
+        if (lengthBlock != 16) {
+            throw std::invalid_argument("GCM needs a 128-bit block cipher");
+        }
+        if (nonce.empty()) {
+            throw std::invalid_argument("GCM needs a non-empty IV");
+        }
+        uint8_t h[16] = {};
+        cipherEncrypt(h, h);
+        ghash.setKey(h);
+        GCMEncryptMode::restart();
+    }
+
+    void restart() override {
+        AEncryptMode::restart();
+        tailBytes = 0;
+        messageOwnsNonce = false;
+        ghash.reset();
+        if (nonce.size() == 12) {
+            std::copy(nonce.begin(), nonce.end(), counter0);
+            std::fill(counter0 + 12, counter0 + 16, 0);
+            counter0[15] = 1;
+        }
+        else {
+            uint8_t lengths[16] = {};
+            uint64ToBytes(static_cast<uint64_t>(nonce.size()) * 8, lengths + 8);
+            ghash.updatePadded(nonce.data(), nonce.size());
+            ghash.update(lengths, 1);
+            ghash.digest(counter0);
+            ghash.reset();
+        }
+        ghash.updatePadded(aad.data(), aad.size());
+    }
+
+    void setIV(const std::vector<uint8_t>& iv) override {
+        if (iv.empty()) {
+            throw std::invalid_argument("GCM needs a non-empty IV");
+        }
+        nonce = iv;
+        nonceUsed = false;
+        AEncryptMode::setIV(iv);
+    }
+
+    void setAAD(const std::vector<uint8_t>& data) override {
+        aad = data;
+    }
+
+    void encryptTail(const uint8_t* in, uint8_t* out, size_t size) override {
+        processTail(in, out, size, true);
+    }
+
+    void decryptTail(const uint8_t* in, uint8_t* out, size_t size) override {
+        processTail(in, out, size, false);
+    }
+
+    void discardNonce() override {
+        nonceUsed = true;
+        messageOwnsNonce = false;
+    }
+
+    std::vector<uint8_t> getTag() override {
+        GHash final = ghash;
+        uint8_t lengths[16];
+        uint64ToBytes(static_cast<uint64_t>(aad.size()) * 8, lengths);
+        uint64ToBytes((blockIndex * 16 + tailBytes) * 8, lengths + 8);
+        final.update(lengths, 1);
+
+        std::vector<uint8_t> tag(16);
+        uint8_t mask[16];
+        final.digest(tag.data());
+        cipherEncrypt(counter0, mask);
+        xorBits(tag.data(), mask, tag.data(), 16);
+        return tag;
+    }
+};
+
+// The mode instantiated for Cipher; with ICrypt it works for any engine.
+template<class Cipher>
 std::unique_ptr<AEncryptMode> getMode(CryptoMode mode,
-                                       ICrypt* encryptor,
+                                       Cipher* encryptor,
                                       std::vector<uint8_t>& InitializationVector)
 {
     int size = encryptor->getBlockLength();
     switch (mode) {
     case CryptoMode::ECB:
-        return std::make_unique<ECBEncryptMode>(encryptor, size, InitializationVector);
-    
+        return std::make_unique<ECBEncryptMode<Cipher>>(encryptor, size, InitializationVector);
+
     case CryptoMode::CBC:
-        return std::make_unique<CBCEncryptMode>(encryptor, size, InitializationVector);
+        return std::make_unique<CBCEncryptMode<Cipher>>(encryptor, size, InitializationVector);
     case CryptoMode::PCBC:
-        return std::make_unique<PCBCEncryptMode>(encryptor, size, InitializationVector);
+        return std::make_unique<PCBCEncryptMode<Cipher>>(encryptor, size, InitializationVector);
     case CryptoMode::CFB:
-        return std::make_unique<CFBEncryptMode>( encryptor, size, InitializationVector);
+        return std::make_unique<CFBEncryptMode<Cipher>>( encryptor, size, InitializationVector);
     case CryptoMode::OFB:
-        return std::make_unique<OFBEncryptMode>(encryptor, size, InitializationVector);
+        return std::make_unique<OFBEncryptMode<Cipher>>(encryptor, size, InitializationVector);
     case CryptoMode::CTR:
-        return std::make_unique<CTREncryptMode>(encryptor, size, InitializationVector);
+        return std::make_unique<CTREncryptMode<Cipher>>(encryptor, size, InitializationVector);
     case CryptoMode::RandomDelta:
-        return std::make_unique<RandomDeltaEncryptMode>(encryptor, size, InitializationVector);
+        return std::make_unique<RandomDeltaEncryptMode<Cipher>>(encryptor, size, InitializationVector);
+    case CryptoMode::GCM:
+        return std::make_unique<GCMEncryptMode<Cipher>>(encryptor, size, InitializationVector);
     default:
-        throw std::exception("cryptmode doesn't exist");
+        throw std::invalid_argument("cryptmode doesn't exist");
     }
 }
\ No newline at end of file
@@ -1,5 +1,12 @@
 #pragma once
 #include<vector>
+#include<cstdint>
+#include<stdexcept>
+#include"Instrumentation.h"
+#include"ScratchArena.h"
+
+constexpr int MAX_BLOCK_LENGTH = 16;
+
 class IExpandKey {
 public:
     virtual std::vector<std::vector<uint8_t>> expand(const std::vector<uint8_t>& key) = 0;
@@ -7,17 +14,60 @@ public:
 };
 
 
+// Round function of a Feistel network. The result goes on data's memory
+// resource, the per-block scratch arena when called from FeistelNetwork.
 class IEncryptConversion {
 public:
-    virtual std::vector<uint8_t> encode(const std::vector<uint8_t>& data, std::vector<uint8_t>& rkey) = 0;
+    virtual ScratchBytes encode(const ScratchBytes& data, std::vector<uint8_t>& rkey) = 0;
     virtual ~IEncryptConversion() = default;
 };
 
 class ICrypt {
 public:
-    virtual std::vector<uint8_t> encrypt(const std::vector<uint8_t>& data) = 0;
-    virtual std::vector<uint8_t> decrypt(const std::vector<uint8_t>& data) = 0;
+    // Raw block interface: reads getBlockLength() bytes from in and writes the same
+    // amount to caller-owned out without allocating. in and out may be the same buffer.
+    virtual void encryptBlock(const uint8_t* in, uint8_t* out) = 0;
+    virtual void decryptBlock(const uint8_t* in, uint8_t* out) = 0;
+
+    // Batch interface: n consecutive independent blocks in one call.
+    virtual void encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) {
+        size_t length = getBlockLength();
+        for (size_t i = 0; i < n; ++i) {
+            encryptBlock(in + i * length, out + i * length);
+        }
+    }
+
+    virtual void decryptBlocks(const uint8_t* in, uint8_t* out, size_t n) {
+        size_t length = getBlockLength();
+        for (size_t i = 0; i < n; ++i) {
+            decryptBlock(in + i * length, out + i * length);
+        }
+    }
+
     virtual ICrypt* setKey(std::vector<uint8_t>& key) = 0;
     virtual int getBlockLength() = 0;
     virtual ~ICrypt() = default;
-};
\ No newline at end of file
+
+    std::vector<uint8_t> encrypt(const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> result(getBlockLength());
+        checkBlock(data);
+        CRYPTO_STAGE(CryptoStage::Cipher, result.size(), 1);
+        encryptBlock(data.data(), result.data());
+        return result;
+    }
+
+    std::vector<uint8_t> decrypt(const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> result(getBlockLength());
+        checkBlock(data);
+        CRYPTO_STAGE(CryptoStage::Cipher, result.size(), 1);
+        decryptBlock(data.data(), result.data());
+        return result;
+    }
+
+private:
+    void checkBlock(const std::vector<uint8_t>& data) {
+        if (data.size() < static_cast<size_t>(getBlockLength())) {
+            throw std::invalid_argument("Data is shorter than block length");
+        }
+    }
+};
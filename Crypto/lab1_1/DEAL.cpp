@@ -0,0 +1,177 @@
+#include "DEAL.h"
+#include "Operations.h"
+#include "DESBitslice.h"
+
+namespace {
+
+// The fixed DES key R of the DEAL key schedule.
+const uint64_t DEAL_SCHEDULE_KEY = 0x1234567890abcdefull;
+
+}
+
+// RK[i] = DES_R(K[i mod s] ^ RK[i - 1]), s key words, RK[-1] = 0. From the
+// second pass over the key words on, the j-th one is also XORed with a constant
+// that has only bit j set, counting from 1 at the most significant end.
+std::vector<std::vector<uint8_t>> DEALExpandKey::expand(const std::vector<uint8_t>& key) {
+    if (key.size() != 16 && key.size() != 24 && key.size() != 32) {
+        throw std::invalid_argument("DEAL key must be 16, 24 or 32 bytes");
+    }
+    size_t words = key.size() / 8;
+    size_t rounds = words == 4 ? 8 : 6;
+
+    std::vector<uint8_t> scheduleKey(8);
+    uint64ToBytes(DEAL_SCHEDULE_KEY, scheduleKey.data());
+    DESKeySchedule schedule;
+    DESExpandKey().expand(scheduleKey, schedule);
+
+    std::vector<std::vector<uint8_t>> roundKeys(rounds, std::vector<uint8_t>(8));
+    uint64_t previous = 0;
+    for (size_t i = 0; i < rounds; ++i) {
+        uint64_t word = bytesToUint64(key.data() + 8 * (i % words)) ^ previous;
+        if (i >= words) {
+            word ^= uint64_t(1) << (63 - (i - words));
+        }
+        previous = desEncryptWord(word, schedule);
+        uint64ToBytes(previous, roundKeys[i].data());
+    }
+
+    return roundKeys;
+}
+
+ScratchBytes DEALEncryptConversion::encode(const ScratchBytes& data, std::vector<uint8_t>& rkey) {
+    DESEncryptor des;
+    des.setKey(rkey);
+    ScratchBytes result(8, 0, data.get_allocator());
+    des.encryptBlock(data.data(), result.data());
+    return result;
+}
+
+DEALEncryptor::DEALEncryptor()
+    : FeistelNetwork(std::make_unique<DEALEncryptConversion>(), std::make_unique<DEALExpandKey>(), 6) {
+    blockLength = 16;
+}
+
+ICrypt* DEALEncryptor::setKey(std::vector<uint8_t>& key) {
+    FeistelNetwork::setKey(key);
+    rounds = static_cast<int>(rKeys.size());
+    return this;
+}
+
+ICrypt* DEALTableEncryptor::setKey(std::vector<uint8_t>& key) {
+    DEALEncryptor::setKey(key);
+    DESExpandKey expander;
+    for (int i = 0; i < rounds; ++i) {
+        expander.expand(rKeys[i], schedules[i]);
+    }
+    return this;
+}
+
+void DEALTableEncryptor::encryptBlock(const uint8_t* in, uint8_t* out) {
+    uint64_t left = bytesToUint64(in);
+    uint64_t right = bytesToUint64(in + 8);
+
+    for (int i = 0; i < rounds - 1; ++i) {
+        uint64_t tmp = left ^ desEncryptWord(right, schedules[i]);
+        left = right;
+        right = tmp;
+    }
+    left ^= desEncryptWord(right, schedules[rounds - 1]);
+
+    uint64ToBytes(left, out);
+    uint64ToBytes(right, out + 8);
+}
+
+void DEALTableEncryptor::decryptBlock(const uint8_t* in, uint8_t* out) {
+    uint64_t left = bytesToUint64(in);
+    uint64_t right = bytesToUint64(in + 8);
+
+    left ^= desEncryptWord(right, schedules[rounds - 1]);
+    for (int i = rounds - 2; i >= 0; --i) {
+        uint64_t tmp = right ^ desEncryptWord(left, schedules[i]);
+        right = left;
+        left = tmp;
+    }
+
+    uint64ToBytes(left, out);
+    uint64ToBytes(right, out + 8);
+}
+
+// Both halves of 64 blocks are sliced once; IP and FP of every inner DES are
+// then only word renaming.
+void DEALTableEncryptor::processSliced(const uint8_t* in, uint8_t* out, const uint64_t (*keys)[16][48], bool decrypt) const {
+    const DESBitsliceIndex& index = DESBitsliceIndex::get();
+    uint64_t halves[2][64];
+    for (int i = 0; i < 64; ++i) {
+        halves[0][i] = bytesToUint64(in + 16 * i);
+        halves[1][i] = bytesToUint64(in + 16 * i + 8);
+    }
+    transposeBits64(halves[0]);
+    transposeBits64(halves[1]);
+
+    // target ^= DES under round key r of source
+    auto round = [&](uint64_t* target, const uint64_t* source, int r) {
+        uint64_t block[64];
+        for (int i = 0; i < 64; ++i) {
+            block[i] = source[index.ip[i]];
+        }
+        desBitsliceRounds(block, keys[r], false);
+        for (int i = 0; i < 64; ++i) {
+            target[i] ^= block[index.fp[i]];
+        }
+    };
+
+    uint64_t* left = halves[0];
+    uint64_t* right = halves[1];
+    if (!decrypt) {
+        for (int r = 0; r < rounds - 1; ++r) {
+            round(left, right, r);
+            std::swap(left, right);
+        }
+        round(left, right, rounds - 1);
+    }
+    else {
+        round(left, right, rounds - 1);
+        for (int r = rounds - 2; r >= 0; --r) {
+            round(right, left, r);
+            std::swap(left, right);
+        }
+    }
+
+    transposeBits64(left);
+    transposeBits64(right);
+    for (int i = 0; i < 64; ++i) {
+        uint64ToBytes(left[i], out + 16 * i);
+        uint64ToBytes(right[i], out + 16 * i + 8);
+    }
+}
+
+void DEALTableEncryptor::processBlocks(const uint8_t* in, uint8_t* out, size_t n, bool decrypt) {
+    size_t sliced = n - n % 64;
+    if (sliced != 0) {
+        // 6 KiB of key masks per round, rebuilt per call on the scratch arena
+        // rather than kept in every keyed engine
+        ScratchScope scratch;
+        std::pmr::vector<uint64_t> masks(static_cast<size_t>(rounds) * 16 * 48, scratch.resource());
+        auto keys = reinterpret_cast<uint64_t (*)[16][48]>(masks.data());
+        for (int r = 0; r < rounds; ++r) {
+            desSliceKeys(schedules[r].subkeys, keys[r]);
+        }
+        for (size_t i = 0; i < sliced; i += 64) {
+            processSliced(in + i * 16, out + i * 16, keys, decrypt);
+        }
+    }
+    for (size_t i = sliced; i < n; ++i) {
+        if (decrypt)
+            DEALTableEncryptor::decryptBlock(in + i * 16, out + i * 16);
+        else
+            DEALTableEncryptor::encryptBlock(in + i * 16, out + i * 16);
+    }
+}
+
+void DEALTableEncryptor::encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) {
+    processBlocks(in, out, n, false);
+}
+
+void DEALTableEncryptor::decryptBlocks(const uint8_t* in, uint8_t* out, size_t n) {
+    processBlocks(in, out, n, true);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include<vector>
+#include<memory>
+#include"FeistelNetwork.h"
+#include"DES.h"
+
+// DEAL (Knudsen, 1998): a 128-bit Feistel network whose round function is DES
+// of one 64-bit half under a per-round key. 128- and 192-bit keys give six
+// rounds, 256-bit keys eight.
+class DEALExpandKey : public IExpandKey {
+public:
+    // Round keys as 8-byte DES keys, each DES (under a fixed key) of a key word
+    // mixed with the previous round key.
+    std::vector<std::vector<uint8_t>> expand(const std::vector<uint8_t>& key) override;
+};
+
+class DEALEncryptConversion : public IEncryptConversion {
+public:
+    ScratchBytes encode(const ScratchBytes& data, std::vector<uint8_t>& rkey) override;
+};
+
+// Reference: the generic network with a DESEncryptor keyed on every call.
+class DEALEncryptor : public FeistelNetwork {
+public:
+    DEALEncryptor();
+
+    ICrypt* setKey(std::vector<uint8_t>& key) override;
+};
+
+// Same cipher as DEALEncryptor, with the round keys expanded once into integer
+// DES schedules. Batches of 64 blocks and more stay bitsliced through all rounds.
+class DEALTableEncryptor : public DEALEncryptor {
+private:
+    static constexpr int MAX_ROUNDS = 8;
+
+    DESKeySchedule schedules[MAX_ROUNDS];
+
+    void processSliced(const uint8_t* in, uint8_t* out, const uint64_t (*keys)[16][48], bool decrypt) const;
+    void processBlocks(const uint8_t* in, uint8_t* out, size_t n, bool decrypt);
+
+public:
+    ICrypt* setKey(std::vector<uint8_t>& key) override;
+    void encryptBlock(const uint8_t* in, uint8_t* out) override;
+    void decryptBlock(const uint8_t* in, uint8_t* out) override;
+    void encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override;
+    void decryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override;
+};
@@ -1,6 +1,38 @@
 #include "DES.h"
 #include "Operations.h" 
 #include "DESConfig.h"
+#include "PermutationTable.h"
+#include "DESBitslice.h"
+
+namespace {
+
+struct DESTables {
+    PermutationTable ip{ INITIAL_PERMUTATION };
+    PermutationTable fp{ FINAL_PERMUTATION };
+    PermutationTable pc1{ PC_1 };
+    PermutationTable pc2{ PC_2 };
+    PermutationTable expand{ P_BLOCK_EXPAND };
+    PermutationTable plain{ P_BLOCK_PLAIN };
+    uint32_t sp[8][64];
+
+    DESTables() {
+        for (int i = 0; i < 8; ++i) {
+            for (int b = 0; b < 64; ++b) {
+                int row = ((b >> 4) & 2) | (b & 1);
+                int col = (b >> 1) & 0xF;
+                uint32_t value = static_cast<uint32_t>(S_BLOCKS[i][row][col]) << (28 - 4 * i);
+                sp[i][b] = static_cast<uint32_t>(plain.apply(static_cast<uint64_t>(value) << 32) >> 32);
+            }
+        }
+    }
+
+    static const DESTables& get() {
+        static const DESTables tables;
+        return tables;
+    }
+};
+
+}
 
 int DESExpandKey::makeC(const std::vector<uint8_t>& pKey) {
     return ((pKey[0] & 0xFF) << 20) |
@@ -16,37 +48,85 @@ int DESExpandKey::makeD(const std::vector<uint8_t>& pKey) {
         (pKey[6] & 0xFF);
 }
 
-std::vector<uint8_t> DESExpandKey::makeCD(int C, int D) {
-    uint64_t CD = (static_cast<uint64_t>(C) << halfKeySize) | D;
-    std::vector<uint8_t> bytes(7);
-    for (int j = 0; j < 7; ++j) {
-        bytes[j] = static_cast<uint8_t>((CD >> ((6 - j) * 8)) & 0xFF);
-    }
-    return bytes;
-}
-
-std::vector<std::vector<uint8_t>> DESExpandKey::expand(const std::vector<uint8_t>& key) {
-    std::vector<std::vector<uint8_t>> keys(rounds);
-    std::vector<uint8_t> permuteKey = permuteBits(key, PC_1);
+void DESExpandKey::expand(const std::vector<uint8_t>& key, DESKeySchedule& schedule) {
+    std::vector<uint8_t> permuteKey = DESTables::get().pc1.apply(key);
     int c = makeC(permuteKey);
     int d = makeD(permuteKey);
 
     for (int i = 0; i < rounds; i++) {
         c = leftCycleShift(CYCLE_SHIFTS[i], c, halfKeySize);
         d = leftCycleShift(CYCLE_SHIFTS[i], d, halfKeySize);
-        auto CD = makeCD(c, d);
-        keys[i] = permuteBits(CD, PC_2);
+        uint64_t CD = (static_cast<uint64_t>(c) << halfKeySize) | d;
+        schedule.subkeys[i] = DESTables::get().pc2.apply(CD << 8) >> 16;
+    }
+}
+
+std::vector<std::vector<uint8_t>> DESExpandKey::expand(const std::vector<uint8_t>& key) {
+    DESKeySchedule schedule;
+    expand(key, schedule);
+
+    std::vector<std::vector<uint8_t>> keys(rounds, std::vector<uint8_t>(6));
+    for (int i = 0; i < rounds; i++) {
+        for (int j = 0; j < 6; ++j) {
+            keys[i][j] = static_cast<uint8_t>(schedule.subkeys[i] >> (40 - 8 * j));
+        }
     }
 
     return keys;
 }
 
-std::vector<uint8_t> DESEncryptConversion::encode(const std::vector<uint8_t>& data, std::vector<uint8_t>& rkey) {
-    std::vector<uint8_t> result;
-    result = permuteBits(data, P_BLOCK_EXPAND);
+// LeftRotate(half, 4 * i + 5) brings the six bits P_BLOCK_EXPAND picks for S-box i
+// down to the low end, so the expansion never materializes.
+static uint32_t desFeistel(uint32_t half, uint64_t subkey) {
+    const auto& sp = DESTables::get().sp;
+    return sp[0][(LeftRotate(half, 5) ^ (subkey >> 42)) & 0x3F]
+        | sp[1][(LeftRotate(half, 9) ^ (subkey >> 36)) & 0x3F]
+        | sp[2][(LeftRotate(half, 13) ^ (subkey >> 30)) & 0x3F]
+        | sp[3][(LeftRotate(half, 17) ^ (subkey >> 24)) & 0x3F]
+        | sp[4][(LeftRotate(half, 21) ^ (subkey >> 18)) & 0x3F]
+        | sp[5][(LeftRotate(half, 25) ^ (subkey >> 12)) & 0x3F]
+        | sp[6][(LeftRotate(half, 29) ^ (subkey >> 6)) & 0x3F]
+        | sp[7][(LeftRotate(half, 1) ^ subkey) & 0x3F];
+}
+
+uint64_t desEncryptWord(uint64_t block, const DESKeySchedule& schedule) {
+    const auto& tables = DESTables::get();
+    block = tables.ip.apply(block);
+    uint32_t left = static_cast<uint32_t>(block >> 32);
+    uint32_t right = static_cast<uint32_t>(block);
+
+    for (int i = 0; i < 15; ++i) {
+        uint32_t tmp = left ^ desFeistel(right, schedule.subkeys[i]);
+        left = right;
+        right = tmp;
+    }
+    left ^= desFeistel(right, schedule.subkeys[15]);
+
+    return tables.fp.apply((static_cast<uint64_t>(left) << 32) | right);
+}
+
+uint64_t desDecryptWord(uint64_t block, const DESKeySchedule& schedule) {
+    const auto& tables = DESTables::get();
+    block = tables.ip.apply(block);
+    uint32_t left = static_cast<uint32_t>(block >> 32);
+    uint32_t right = static_cast<uint32_t>(block);
+
+    left ^= desFeistel(right, schedule.subkeys[15]);
+    for (int i = 14; i >= 0; --i) {
+        uint32_t tmp = right ^ desFeistel(left, schedule.subkeys[i]);
+        right = left;
+        left = tmp;
+    }
+
+    return tables.fp.apply((static_cast<uint64_t>(left) << 32) | right);
+}
+
+ScratchBytes DESEncryptConversion::encode(const ScratchBytes& data, std::vector<uint8_t>& rkey) {
+    const auto& tables = DESTables::get();
+    ScratchBytes result = tables.expand.apply(data);
     result = xorBits(result, rkey);
     result = substitution(result);
-    result = permuteBits(result, P_BLOCK_PLAIN); 
+    result = tables.plain.apply(result);
     return result;
 }
 
@@ -55,15 +135,81 @@ DESEncryptor::DESEncryptor()
     blockLength = 8;
 }
 
-std::vector<uint8_t> DESEncryptor::encrypt(std::vector<uint8_t> data) {
-    auto initialPermutedBlock = permuteBits(data, INITIAL_PERMUTATION);
-    auto encryptedBlock = FeistelNetwork::encrypt(initialPermutedBlock);
-    return permuteBits(encryptedBlock, FINAL_PERMUTATION);
+void DESEncryptor::encryptBlock(const uint8_t* in, uint8_t* out) {
+    uint8_t block[8];
+    DESTables::get().ip.apply(in, block);
+    FeistelNetwork::encryptBlock(block, block);
+    DESTables::get().fp.apply(block, out);
+}
+
+void DESEncryptor::decryptBlock(const uint8_t* in, uint8_t* out) {
+    uint8_t block[8];
+    DESTables::get().ip.apply(in, block);
+    FeistelNetwork::decryptBlock(block, block);
+    DESTables::get().fp.apply(block, out);
+}
+
+void DESEncryptor::encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        DESEncryptor::encryptBlock(in + i * 8, out + i * 8);
+    }
+}
+
+void DESEncryptor::decryptBlocks(const uint8_t* in, uint8_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        DESEncryptor::decryptBlock(in + i * 8, out + i * 8);
+    }
+}
+
+DESTableEncryptor::DESTableEncryptor()
+    : expandKey(std::make_unique<DESExpandKey>()) {
+}
+
+ICrypt* DESTableEncryptor::setKey(std::vector<uint8_t>& key) {
+    expandKey->expand(key, schedule);
+    desSliceKeys(schedule.subkeys, slicedKeys);
+    return this;
 }
 
-std::vector<uint8_t> DESEncryptor::decrypt(std::vector<uint8_t> data) {
-    auto initialPermutedBlock = permuteBits(data, INITIAL_PERMUTATION);
-    auto decryptedBlock = FeistelNetwork::decrypt(initialPermutedBlock);
-    return permuteBits(decryptedBlock, FINAL_PERMUTATION);
+int DESTableEncryptor::getBlockLength() {
+    return 8;
 }
 
+void DESTableEncryptor::encryptBlock(const uint8_t* in, uint8_t* out) {
+    uint64ToBytes(desEncryptWord(bytesToUint64(in), schedule), out);
+}
+
+void DESTableEncryptor::decryptBlock(const uint8_t* in, uint8_t* out) {
+    uint64ToBytes(desDecryptWord(bytesToUint64(in), schedule), out);
+}
+
+void DESTableEncryptor::processBlocks(const uint8_t* in, uint8_t* out, size_t n, bool decrypt) {
+    size_t i = 0;
+#if defined(SERPENT_SIMD_AVX2)
+    if (serpentSimdLevel() == SerpentSimdLevel::Avx2) {
+        for (; i + 256 <= n; i += 256) {
+            desBitsliceBlocksAvx2(in + i * 8, out + i * 8, slicedKeys, decrypt);
+        }
+    }
+#endif
+#if defined(SERPENT_SIMD_SSE2)
+    for (; i + 128 <= n; i += 128) {
+        desBitsliceBlocks<SerpentSse2Word>(in + i * 8, out + i * 8, slicedKeys, decrypt);
+    }
+#endif
+    for (; i + 64 <= n; i += 64) {
+        desBitsliceBlocks<uint64_t>(in + i * 8, out + i * 8, slicedKeys, decrypt);
+    }
+    for (; i < n; ++i) {
+        uint64_t block = bytesToUint64(in + i * 8);
+        uint64ToBytes(decrypt ? desDecryptWord(block, schedule) : desEncryptWord(block, schedule), out + i * 8);
+    }
+}
+
+void DESTableEncryptor::encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) {
+    processBlocks(in, out, n, false);
+}
+
+void DESTableEncryptor::decryptBlocks(const uint8_t* in, uint8_t* out, size_t n) {
+    processBlocks(in, out, n, true);
+}
@@ -3,6 +3,11 @@
 #include<memory>
 #include"FeistelNetwork.h"
 
+// Round keys as 48-bit values, first PC_2 output bit in bit 47.
+struct alignas(64) DESKeySchedule {
+    uint64_t subkeys[16];
+};
+
 class DESExpandKey : public IExpandKey {
 private:
     int rounds = 16;
@@ -11,19 +16,51 @@ private:
 protected:
     int makeC(const std::vector<uint8_t>& pKey);
     int makeD(const std::vector<uint8_t>& pKey);
-    std::vector<uint8_t> makeCD(int C, int D);
     std::vector<std::vector<uint8_t>> expand(const std::vector<uint8_t>& key) override;
+
+public:
+    void expand(const std::vector<uint8_t>& key, DESKeySchedule& schedule);
 };
 
+// DES on one block held big-endian in a uint64_t, with the table-driven rounds
+// of DESTableEncryptor; for engines that keep schedules of their own.
+uint64_t desEncryptWord(uint64_t block, const DESKeySchedule& schedule);
+uint64_t desDecryptWord(uint64_t block, const DESKeySchedule& schedule);
+
 class DESEncryptConversion : public IEncryptConversion {
 public:
-    std::vector<uint8_t> encode(const std::vector<uint8_t>& data, std::vector<uint8_t>& rkey) override;
+    ScratchBytes encode(const ScratchBytes& data, std::vector<uint8_t>& rkey) override;
 };
 
 class DESEncryptor : public FeistelNetwork {
 public:
     DESEncryptor();
 
-    std::vector<uint8_t> encrypt(std::vector<uint8_t> data);
-    std::vector<uint8_t> decrypt(std::vector<uint8_t> data);
+    void encryptBlock(const uint8_t* in, uint8_t* out) override;
+    void decryptBlock(const uint8_t* in, uint8_t* out) override;
+    void encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override;
+    void decryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override;
+};
+
+// Same cipher as DESEncryptor, but the halves live in uint32_t and every round is
+// eight lookups into tables that fuse S_BLOCKS with P_BLOCK_PLAIN. Batches of 64
+// blocks and more go through the bitsliced engine from DESBitslice.h, 256 at a
+// time on AVX2 and 128 on SSE2.
+class DESTableEncryptor : public ICrypt {
+private:
+    DESKeySchedule schedule;
+    uint64_t slicedKeys[16][48];
+    std::unique_ptr<DESExpandKey> expandKey;
+
+    void processBlocks(const uint8_t* in, uint8_t* out, size_t n, bool decrypt);
+
+public:
+    DESTableEncryptor();
+
+    ICrypt* setKey(std::vector<uint8_t>& key) override;
+    int getBlockLength() override;
+    void encryptBlock(const uint8_t* in, uint8_t* out) override;
+    void decryptBlock(const uint8_t* in, uint8_t* out) override;
+    void encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override;
+    void decryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override;
 };
@@ -0,0 +1,651 @@
+#pragma once
+
+#include "DESConfig.h"
+#include "Operations.h"
+#include "SerpentSimd.h"
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+// Bitsliced DES: 64 blocks per 64 bits of the word type, word k holding bit k of
+// every block, one block per bit lane. IP, E, P and FP turn into word renaming, so a round is
+// only key XORs, the S-box circuits and the XOR into the other half.
+
+// S_BLOCKS[i] as gate circuits; x0 is the first (most significant) of the six
+// input bits, y0 the first output bit. Each output is split on two inputs into
+// four functions of the other four, y = e0 ^ (a & e1) ^ (b & (e2 ^ (a & e3))),
+// and those sixteen functions share their AND, OR, XOR and AND-NOT gates: 57
+// gates per S-box on average, against about 180 for the algebraic normal form.
+template<class W>
+inline void desSbox0(W x0, W x1, W x2, W x3, W x4, W x5, W& y0, W& y1, W& y2, W& y3) {
+	W t0 = x2 ^ x5;
+	W t1 = x3 & t0;
+	W t2 = ~t1;
+	W t3 = t2 ^ x3;
+	W t4 = ~x2 & t3;
+	W t5 = x1 | t4;
+	W t6 = x2 ^ t5;
+	W t7 = ~x3 & t5;
+	W t8 = x1 ^ t7;
+	W t9 = t1 | t8;
+	W t10 = ~x5 & t6;
+	W t11 = t8 ^ t10;
+	W t12 = t1 | t11;
+	W t13 = t3 & x5;
+	W t14 = t8 ^ t13;
+	W t15 = x3 ^ t14;
+	W t16 = t13 ^ t7;
+	W t17 = ~t11 & t16;
+	W t18 = t17 ^ t9;
+	W t19 = t2 ^ t18;
+	W t20 = t7 ^ t15;
+	W t21 = t17 ^ t20;
+	W t22 = t18 ^ t0;
+	W t23 = t10 | t22;
+	W t24 = ~t8 & t6;
+	W t25 = t18 ^ t24;
+	W t26 = t25 ^ t6;
+	W t27 = x3 ^ t26;
+	W t28 = ~t27 & t19;
+	W t29 = t20 ^ t28;
+	W t30 = t20 ^ t6;
+	W t31 = t13 | t30;
+	W t32 = t31 ^ t26;
+	W t33 = ~t12 & t23;
+	W t34 = ~t33 & t29;
+	W t35 = t12 ^ t34;
+	W t36 = ~x3 & t29;
+	W t37 = t33 ^ t36;
+	W t38 = x4 & t21;
+	W t39 = t6 ^ t38;
+	W t40 = x0 & t39;
+	W t41 = x4 & t2;
+	W t42 = t15 ^ t41;
+	y0 = t42 ^ t40;
+	W t43 = x4 & t37;
+	W t44 = t25 ^ t43;
+	W t45 = x0 & t44;
+	W t46 = x4 & t29;
+	W t47 = t27 ^ t46;
+	y1 = t47 ^ t45;
+	W t48 = x4 & t19;
+	W t49 = t31 ^ t48;
+	W t50 = x0 & t49;
+	W t51 = x4 & t9;
+	W t52 = t23 ^ t51;
+	y2 = t52 ^ t50;
+	W t53 = x4 & t17;
+	W t54 = t32 ^ t53;
+	W t55 = x0 & t54;
+	W t56 = x4 & t12;
+	W t57 = t35 ^ t56;
+	y3 = t57 ^ t55;
+}
+
+template<class W>
+inline void desSbox1(W x0, W x1, W x2, W x3, W x4, W x5, W& y0, W& y1, W& y2, W& y3) {
+	W t0 = x4 & x5;
+	W t1 = ~t0 & x0;
+	W t2 = ~t1 & x4;
+	W t3 = x1 | t2;
+	W t4 = t1 & x4;
+	W t5 = ~t4 & x1;
+	W t6 = x5 ^ t5;
+	W t7 = x1 & t6;
+	W t8 = t0 | t7;
+	W t9 = ~t8;
+	W t10 = x0 ^ x5;
+	W t11 = t9 | t10;
+	W t12 = x4 ^ t10;
+	W t13 = x1 ^ t12;
+	W t14 = ~t13;
+	W t15 = ~x0 & t14;
+	W t16 = x1 ^ t15;
+	W t17 = t16 ^ t7;
+	W t18 = t3 & t17;
+	W t19 = ~t18;
+	W t20 = ~t17 & t11;
+	W t21 = ~t20;
+	W t22 = x4 ^ t17;
+	W t23 = ~t4 & t22;
+	W t24 = t6 ^ t23;
+	W t25 = t20 ^ t3;
+	W t26 = t22 ^ t25;
+	W t27 = x1 ^ t11;
+	W t28 = t1 | t27;
+	W t29 = t12 ^ t28;
+	W t30 = t7 ^ t26;
+	W t31 = t2 ^ t30;
+	W t32 = x0 ^ t31;
+	W t33 = t6 ^ t30;
+	W t34 = t27 & t33;
+	W t35 = t29 ^ t34;
+	W t36 = x3 & t3;
+	W t37 = x2 & t11;
+	W t38 = t29 ^ t37;
+	y0 = t38 ^ t36;
+	W t39 = x2 & t0;
+	W t40 = t9 ^ t39;
+	W t41 = x3 & t40;
+	W t42 = x2 & t6;
+	W t43 = t14 ^ t42;
+	y1 = t43 ^ t41;
+	W t44 = x2 & t16;
+	W t45 = t26 ^ t44;
+	W t46 = x3 & t45;
+	W t47 = x2 & t35;
+	W t48 = t32 ^ t47;
+	y2 = t48 ^ t46;
+	W t49 = x3 & t19;
+	W t50 = x2 & t21;
+	W t51 = t24 ^ t50;
+	y3 = t51 ^ t49;
+}
+
+template<class W>
+inline void desSbox2(W x0, W x1, W x2, W x3, W x4, W x5, W& y0, W& y1, W& y2, W& y3) {
+	W t0 = ~x4 & x3;
+	W t1 = x5 ^ t0;
+	W t2 = x1 ^ t1;
+	W t3 = t2 ^ x4;
+	W t4 = x5 | t3;
+	W t5 = x3 | t4;
+	W t6 = x5 & x3;
+	W t7 = t2 | t6;
+	W t8 = t0 | t7;
+	W t9 = ~x3 & t8;
+	W t10 = t1 | t9;
+	W t11 = t4 ^ t10;
+	W t12 = x1 & t5;
+	W t13 = ~t12 & t8;
+	W t14 = x3 ^ t13;
+	W t15 = t12 | t6;
+	W t16 = t2 & t15;
+	W t17 = ~t16;
+	W t18 = t17 ^ t7;
+	W t19 = ~t13 & t18;
+	W t20 = ~t6 & x4;
+	W t21 = t17 ^ t20;
+	W t22 = t12 | t21;
+	W t23 = t13 ^ t22;
+	W t24 = t8 ^ t23;
+	W t25 = ~x1 & t14;
+	W t26 = t21 ^ t25;
+	W t27 = ~t0 & t26;
+	W t28 = t26 | t16;
+	W t29 = t13 ^ t28;
+	W t30 = t5 ^ t28;
+	W t31 = t29 ^ t10;
+	W t32 = t6 | t31;
+	W t33 = t8 & t14;
+	W t34 = t31 ^ t33;
+	W t35 = x0 & t30;
+	W t36 = t29 ^ t35;
+	W t37 = x2 & t36;
+	W t38 = x0 & t8;
+	W t39 = t34 ^ t38;
+	y0 = t39 ^ t37;
+	W t40 = x0 & t16;
+	W t41 = t21 ^ t40;
+	W t42 = x2 & t41;
+	W t43 = x0 & t17;
+	W t44 = t14 ^ t43;
+	y1 = t44 ^ t42;
+	W t45 = x0 & t11;
+	W t46 = t5 ^ t45;
+	W t47 = x2 & t46;
+	W t48 = x0 & t19;
+	W t49 = t27 ^ t48;
+	y2 = t49 ^ t47;
+	W t50 = x0 & t24;
+	W t51 = x4 ^ t50;
+	W t52 = x2 & t51;
+	W t53 = x0 & t32;
+	W t54 = t2 ^ t53;
+	y3 = t54 ^ t52;
+}
+
+template<class W>
+inline void desSbox3(W x0, W x1, W x2, W x3, W x4, W x5, W& y0, W& y1, W& y2, W& y3) {
+	W t0 = x4 ^ x2;
+	W t1 = ~x1 & t0;
+	W t2 = x3 ^ t1;
+	W t3 = ~x4 & x2;
+	W t4 = ~t3 & t2;
+	W t5 = x3 ^ x1;
+	W t6 = t4 | t5;
+	W t7 = t3 ^ t0;
+	W t8 = t2 | t7;
+	W t9 = ~t8;
+	W t10 = t9 ^ t6;
+	W t11 = t10 & t5;
+	W t12 = ~t11;
+	W t13 = t12 ^ t4;
+	W t14 = t12 | t1;
+	W t15 = x4 & t14;
+	W t16 = t9 ^ t15;
+	W t17 = x3 ^ t15;
+	W t18 = x2 | t17;
+	W t19 = t6 & t18;
+	W t20 = t17 | t19;
+	W t21 = x1 ^ t20;
+	W t22 = ~t21;
+	W t23 = t21 ^ t16;
+	W t24 = t17 ^ x4;
+	W t25 = t23 ^ t24;
+	W t26 = ~t25;
+	W t27 = t19 ^ t25;
+	W t28 = x0 & t4;
+	W t29 = t25 ^ t28;
+	W t30 = x5 & t29;
+	W t31 = x0 & t12;
+	W t32 = t19 ^ t31;
+	y0 = t32 ^ t30;
+	W t33 = t26 ^ t28;
+	W t34 = x5 & t33;
+	W t35 = x0 & t13;
+	W t36 = t27 ^ t35;
+	y1 = t36 ^ t34;
+	W t37 = x0 & t9;
+	W t38 = t22 ^ t37;
+	W t39 = x5 & t38;
+	W t40 = x0 & t6;
+	W t41 = t23 ^ t40;
+	y2 = t41 ^ t39;
+	W t42 = t21 ^ t37;
+	W t43 = x5 & t42;
+	W t44 = x0 & t10;
+	W t45 = t16 ^ t44;
+	y3 = t45 ^ t43;
+}
+
+template<class W>
+inline void desSbox4(W x0, W x1, W x2, W x3, W x4, W x5, W& y0, W& y1, W& y2, W& y3) {
+	W t0 = ~x0 & x3;
+	W t1 = ~x5 & x2;
+	W t2 = t1 | t0;
+	W t3 = x5 ^ t2;
+	W t4 = x5 & x2;
+	W t5 = t3 ^ t4;
+	W t6 = ~x0 & t5;
+	W t7 = ~t6;
+	W t8 = x5 | x3;
+	W t9 = x2 ^ t8;
+	W t10 = t7 ^ t9;
+	W t11 = t2 & t10;
+	W t12 = t5 ^ t11;
+	W t13 = t3 | x0;
+	W t14 = t10 & t13;
+	W t15 = ~t14;
+	W t16 = t15 | t8;
+	W t17 = t12 ^ t16;
+	W t18 = t9 ^ x3;
+	W t19 = t13 ^ t18;
+	W t20 = ~t19;
+	W t21 = t19 ^ x0;
+	W t22 = x3 | t21;
+	W t23 = t21 & x5;
+	W t24 = t0 ^ t23;
+	W t25 = t10 | t6;
+	W t26 = t22 ^ t25;
+	W t27 = t16 & t26;
+	W t28 = t18 ^ t27;
+	W t29 = t12 ^ x0;
+	W t30 = t24 | t29;
+	W t31 = ~t24 & t26;
+	W t32 = x3 ^ t31;
+	W t33 = t3 | t9;
+	W t34 = t12 ^ t33;
+	W t35 = t24 ^ t34;
+	W t36 = t35 | t32;
+	W t37 = t15 ^ t36;
+	W t38 = t4 ^ t37;
+	W t39 = x1 & t24;
+	W t40 = t28 ^ t39;
+	W t41 = x4 & t40;
+	W t42 = x1 & t26;
+	W t43 = t12 ^ t42;
+	y0 = t43 ^ t41;
+	W t44 = x4 & t32;
+	W t45 = x1 & t22;
+	W t46 = t38 ^ t45;
+	y1 = t46 ^ t44;
+	W t47 = x1 & t15;
+	W t48 = t7 ^ t47;
+	W t49 = x4 & t48;
+	W t50 = x1 & t10;
+	W t51 = t20 ^ t50;
+	y2 = t51 ^ t49;
+	W t52 = x1 & t17;
+	W t53 = t3 ^ t52;
+	W t54 = x4 & t53;
+	W t55 = x1 & t30;
+	W t56 = t35 ^ t55;
+	y3 = t56 ^ t54;
+}
+
+template<class W>
+inline void desSbox5(W x0, W x1, W x2, W x3, W x4, W x5, W& y0, W& y1, W& y2, W& y3) {
+	W t0 = ~x1 & x5;
+	W t1 = ~t0 & x0;
+	W t2 = x4 ^ t1;
+	W t3 = x5 ^ x4;
+	W t4 = ~t3 & x0;
+	W t5 = t2 ^ t4;
+	W t6 = x1 ^ x0;
+	W t7 = t3 ^ t6;
+	W t8 = ~t7;
+	W t9 = t5 & t8;
+	W t10 = ~t9;
+	W t11 = x1 ^ t5;
+	W t12 = x4 ^ t11;
+	W t13 = ~t12;
+	W t14 = t12 | t9;
+	W t15 = t13 ^ t2;
+	W t16 = ~x5 & t15;
+	W t17 = ~x5 & t2;
+	W t18 = t14 | t17;
+	W t19 = t0 | t16;
+	W t20 = x0 ^ t19;
+	W t21 = ~t19 & t18;
+	W t22 = t3 ^ t21;
+	W t23 = t21 | t11;
+	W t24 = t7 ^ t23;
+	W t25 = t24 & t3;
+	W t26 = x4 | t25;
+	W t27 = ~t9 & t24;
+	W t28 = ~t27 & t2;
+	W t29 = ~t28;
+	W t30 = t1 | t23;
+	W t31 = t29 ^ t30;
+	W t32 = x0 | t0;
+	W t33 = t17 ^ t32;
+	W t34 = ~t33;
+	W t35 = x3 & t34;
+	W t36 = t22 ^ t35;
+	W t37 = x2 & t36;
+	W t38 = x3 & t26;
+	W t39 = t20 ^ t38;
+	y0 = t39 ^ t37;
+	W t40 = x3 & t5;
+	W t41 = t29 ^ t40;
+	W t42 = x2 & t41;
+	W t43 = x3 & t31;
+	W t44 = t8 ^ t43;
+	y1 = t44 ^ t42;
+	W t45 = x2 & t18;
+	W t46 = x3 & t10;
+	W t47 = t24 ^ t46;
+	y2 = t47 ^ t45;
+	W t48 = x3 & t16;
+	W t49 = t13 ^ t48;
+	W t50 = x2 & t49;
+	W t51 = x3 & t14;
+	W t52 = t2 ^ t51;
+	y3 = t52 ^ t50;
+}
+
+template<class W>
+inline void desSbox6(W x0, W x1, W x2, W x3, W x4, W x5, W& y0, W& y1, W& y2, W& y3) {
+	W t0 = ~x4 & x3;
+	W t1 = x1 & t0;
+	W t2 = ~t1;
+	W t3 = x1 & x2;
+	W t4 = t2 ^ t3;
+	W t5 = t4 ^ x2;
+	W t6 = ~x4 & t5;
+	W t7 = ~t6;
+	W t8 = x3 & x2;
+	W t9 = ~t8 & t4;
+	W t10 = t0 | t9;
+	W t11 = t5 ^ t8;
+	W t12 = t6 ^ t11;
+	W t13 = t10 ^ t12;
+	W t14 = ~x3 & x4;
+	W t15 = t10 ^ t14;
+	W t16 = x2 ^ t15;
+	W t17 = ~x1 & t9;
+	W t18 = t16 ^ t17;
+	W t19 = ~x1 & t12;
+	W t20 = ~t19 & t16;
+	W t21 = t2 ^ t20;
+	W t22 = t4 ^ t18;
+	W t23 = ~t17 & t22;
+	W t24 = t0 ^ t23;
+	W t25 = ~t22 & x3;
+	W t26 = x1 ^ t25;
+	W t27 = ~t22 & t5;
+	W t28 = t0 | t27;
+	W t29 = t6 ^ t28;
+	W t30 = t21 ^ t29;
+	W t31 = t10 & t26;
+	W t32 = t18 ^ t31;
+	W t33 = x4 ^ t30;
+	W t34 = t5 ^ t33;
+	W t35 = t14 ^ t34;
+	W t36 = x0 & t16;
+	W t37 = t10 ^ t36;
+	W t38 = x5 & t37;
+	W t39 = x0 & t28;
+	W t40 = t21 ^ t39;
+	y0 = t40 ^ t38;
+	W t41 = x0 & t4;
+	W t42 = t26 ^ t41;
+	W t43 = x5 & t42;
+	W t44 = x0 & t29;
+	W t45 = t30 ^ t44;
+	y1 = t45 ^ t43;
+	W t46 = x0 & t13;
+	W t47 = t32 ^ t46;
+	W t48 = x5 & t47;
+	W t49 = x0 & t7;
+	W t50 = t35 ^ t49;
+	y2 = t50 ^ t48;
+	W t51 = x0 & t24;
+	W t52 = t2 ^ t51;
+	W t53 = x5 & t52;
+	W t54 = t18 ^ x0;
+	y3 = t54 ^ t53;
+}
+
+template<class W>
+inline void desSbox7(W x0, W x1, W x2, W x3, W x4, W x5, W& y0, W& y1, W& y2, W& y3) {
+	W t0 = x4 ^ x2;
+	W t1 = x3 | t0;
+	W t2 = ~t1 & x1;
+	W t3 = x2 ^ x3;
+	W t4 = ~t3 & x4;
+	W t5 = x1 ^ t4;
+	W t6 = x2 ^ t5;
+	W t7 = ~t5 & t1;
+	W t8 = t7 & t0;
+	W t9 = t1 ^ t8;
+	W t10 = x4 & t9;
+	W t11 = x3 ^ t10;
+	W t12 = ~t11;
+	W t13 = t12 ^ t7;
+	W t14 = ~x4 & t13;
+	W t15 = ~t8 & t14;
+	W t16 = ~t15;
+	W t17 = t13 ^ t16;
+	W t18 = t6 ^ t11;
+	W t19 = t15 ^ t18;
+	W t20 = ~x1 & t17;
+	W t21 = t15 | t20;
+	W t22 = ~t20 & t7;
+	W t23 = t11 ^ t22;
+	W t24 = t20 | t23;
+	W t25 = t6 ^ t24;
+	W t26 = t6 | t19;
+	W t27 = x1 ^ t26;
+	W t28 = t27 ^ t25;
+	W t29 = ~t28;
+	W t30 = ~t28 & t16;
+	W t31 = t11 | t30;
+	W t32 = x5 & t13;
+	W t33 = t17 ^ t32;
+	W t34 = x0 & t33;
+	W t35 = x5 & t27;
+	W t36 = t25 ^ t35;
+	y0 = t36 ^ t34;
+	W t37 = x5 & t23;
+	W t38 = t7 ^ t37;
+	W t39 = x0 & t38;
+	W t40 = t19 ^ x5;
+	y1 = t40 ^ t39;
+	W t41 = x5 & t31;
+	W t42 = t12 ^ t41;
+	W t43 = x0 & t42;
+	W t44 = x5 & t2;
+	W t45 = t6 ^ t44;
+	y2 = t45 ^ t43;
+	W t46 = x5 & t21;
+	W t47 = t16 ^ t46;
+	W t48 = x0 & t47;
+	W t49 = x5 & t9;
+	W t50 = t29 ^ t49;
+	y3 = t50 ^ t48;
+}
+
+template<class W>
+inline void desSbox(int index, const W* x, W* y) {
+	switch (index) {
+	case 0: desSbox0(x[0], x[1], x[2], x[3], x[4], x[5], y[0], y[1], y[2], y[3]); break;
+	case 1: desSbox1(x[0], x[1], x[2], x[3], x[4], x[5], y[0], y[1], y[2], y[3]); break;
+	case 2: desSbox2(x[0], x[1], x[2], x[3], x[4], x[5], y[0], y[1], y[2], y[3]); break;
+	case 3: desSbox3(x[0], x[1], x[2], x[3], x[4], x[5], y[0], y[1], y[2], y[3]); break;
+	case 4: desSbox4(x[0], x[1], x[2], x[3], x[4], x[5], y[0], y[1], y[2], y[3]); break;
+	case 5: desSbox5(x[0], x[1], x[2], x[3], x[4], x[5], y[0], y[1], y[2], y[3]); break;
+	case 6: desSbox6(x[0], x[1], x[2], x[3], x[4], x[5], y[0], y[1], y[2], y[3]); break;
+	default: desSbox7(x[0], x[1], x[2], x[3], x[4], x[5], y[0], y[1], y[2], y[3]); break;
+	}
+}
+
+// Key masks are kept as uint64_t; wider words take them broadcast.
+template<class W>
+inline W desKeyWord(uint64_t mask) {
+	return W(static_cast<uint32_t>(mask));
+}
+
+template<>
+inline uint64_t desKeyWord<uint64_t>(uint64_t mask) {
+	return mask;
+}
+
+// Feeds S-box Index with its six expanded and keyed input words.
+template<int Index, class W>
+inline void desSboxGroup(const W* right, const uint64_t* key, const uint8_t* expand, W* sOut) {
+	W x[6];
+	for (int j = 0; j < 6; ++j) {
+		x[j] = right[expand[6 * Index + j]] ^ desKeyWord<W>(key[6 * Index + j]);
+	}
+	desSbox(Index, x, sOut + 4 * Index);
+}
+
+// DESConfig tables as 0-indexed word numbers.
+struct DESBitsliceIndex {
+	uint8_t ip[64];
+	uint8_t fp[64];
+	uint8_t expand[48];
+	uint8_t plain[32];
+
+	DESBitsliceIndex() {
+		for (int i = 0; i < 64; ++i) {
+			ip[i] = static_cast<uint8_t>(INITIAL_PERMUTATION[i] - 1);
+			fp[i] = static_cast<uint8_t>(FINAL_PERMUTATION[i] - 1);
+		}
+		for (int i = 0; i < 48; ++i) {
+			expand[i] = static_cast<uint8_t>(P_BLOCK_EXPAND[i] - 1);
+		}
+		for (int i = 0; i < 32; ++i) {
+			plain[i] = static_cast<uint8_t>(P_BLOCK_PLAIN[i] - 1);
+		}
+	}
+
+	static const DESBitsliceIndex& get() {
+		static const DESBitsliceIndex index;
+		return index;
+	}
+};
+
+// Sixteen rounds on a sliced block that already went through IP. keys[r][k] is
+// all ones where bit k of the r-th subkey is set; decryption walks them backwards.
+template<class W>
+inline void desBitsliceRounds(W* block, const uint64_t (*keys)[48], bool decrypt) {
+	const DESBitsliceIndex& index = DESBitsliceIndex::get();
+	W* left = block;
+	W* right = block + 32;
+
+	for (int round = 0; round < 16; ++round) {
+		const uint64_t* key = keys[decrypt ? 15 - round : round];
+		W sOut[32];
+		desSboxGroup<0>(right, key, index.expand, sOut);
+		desSboxGroup<1>(right, key, index.expand, sOut);
+		desSboxGroup<2>(right, key, index.expand, sOut);
+		desSboxGroup<3>(right, key, index.expand, sOut);
+		desSboxGroup<4>(right, key, index.expand, sOut);
+		desSboxGroup<5>(right, key, index.expand, sOut);
+		desSboxGroup<6>(right, key, index.expand, sOut);
+		desSboxGroup<7>(right, key, index.expand, sOut);
+		for (int j = 0; j < 32; ++j) {
+			left[j] = left[j] ^ sOut[index.plain[j]];
+		}
+		if (round != 15) {
+			std::swap(left, right);
+		}
+	}
+
+	if (left != block) {
+		for (int j = 0; j < 32; ++j) {
+			std::swap(block[j], block[32 + j]);
+		}
+	}
+}
+
+// keys[r][k] for desBitsliceRounds from sixteen 48-bit subkeys, first PC_2 bit in bit 47.
+inline void desSliceKeys(const uint64_t* subkeys, uint64_t (*keys)[48]) {
+	for (int r = 0; r < 16; ++r) {
+		for (int j = 0; j < 48; ++j) {
+			keys[r][j] = ((subkeys[r] >> (47 - j)) & 1) ? ~uint64_t(0) : 0;
+		}
+	}
+}
+
+// 8 * sizeof(W) consecutive 8-byte blocks from in to out, W being uint64_t or a
+// word from SerpentSimd.h; in and out may be the same buffer.
+template<class W>
+inline void desBitsliceBlocks(const uint8_t* in, uint8_t* out, const uint64_t (*keys)[48], bool decrypt) {
+	constexpr int GROUPS = sizeof(W) / 8;
+	const DESBitsliceIndex& index = DESBitsliceIndex::get();
+	// 64 blocks per group; once transposed, rows[64 * g + k] is bit k of them
+	uint64_t rows[64 * GROUPS];
+	W block[64];
+
+	for (int g = 0; g < GROUPS; ++g) {
+		for (int i = 0; i < 64; ++i) {
+			rows[64 * g + i] = bytesToUint64(in + 8 * (64 * g + i));
+		}
+		transposeBits64(rows + 64 * g);
+	}
+
+	for (int i = 0; i < 64; ++i) {
+		block[i] = gatherSlice<W>(rows + index.ip[i], 64);
+	}
+	desBitsliceRounds(block, keys, decrypt);
+	for (int i = 0; i < 64; ++i) {
+		scatterSlice(block[index.fp[i]], rows + i, 64);
+	}
+
+	for (int g = 0; g < GROUPS; ++g) {
+		transposeBits64(rows + 64 * g);
+		for (int i = 0; i < 64; ++i) {
+			uint64ToBytes(rows[64 * g + i], out + 8 * (64 * g + i));
+		}
+	}
+}
+
+#if defined(SERPENT_SIMD_AVX2)
+SERPENT_AVX2_KERNEL inline void desBitsliceBlocksAvx2(const uint8_t* in, uint8_t* out, const uint64_t (*keys)[48], bool decrypt) {
+	desBitsliceBlocks<SerpentAvx2Word>(in, out, keys, decrypt);
+}
+#endif
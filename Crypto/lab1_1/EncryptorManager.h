@@ -1,10 +1,13 @@
 #pragma once
 
+#include <typeinfo>
 #include "Cryptmodes.h"
 #include "Paddings.h"
 #include "DES.h"
+#include "DEAL.h"
 #include "MARS.h"
 #include "Serpent.h"
+#include "SerpentBitslice.h"
 
 enum class EncryptionAlgorithm {
 	DES,
@@ -13,51 +16,381 @@ enum class EncryptionAlgorithm {
 	SERPENT
 };
 
+enum class StreamDirection {
+	Encrypt,
+	Decrypt
+};
+
+// Reference engines are the original table-driven classes; optimized ones must
+// produce identical ciphertexts.
+enum class CipherBackend {
+	Reference,
+	Optimized
+};
+
+// Unkeyed cipher for algorithm, owned by the caller.
+inline ICrypt* makeCipher(EncryptionAlgorithm algorithm, CipherBackend backend = CipherBackend::Reference) {
+	switch (algorithm) {
+		case(EncryptionAlgorithm::DES):
+			if (backend == CipherBackend::Optimized)
+				return new DESTableEncryptor();
+			else
+				return new DESEncryptor();
+		case(EncryptionAlgorithm::DEAL):
+			if (backend == CipherBackend::Optimized)
+				return new DEALTableEncryptor();
+			else
+				return new DEALEncryptor();
+		case(EncryptionAlgorithm::MARS):
+			return new MARS();
+		case(EncryptionAlgorithm::SERPENT):
+			if (backend == CipherBackend::Optimized)
+				return new SerpentBitslice();
+			else
+				return new Serpent();
+		default:
+			throw std::invalid_argument("whong algorithm");
+	}
+}
+
+// Mode for a keyed engine, chosen once per manager: the optimized engines get an
+// instantiation over their own type, so the mode loops call straight into them;
+// anything else goes through ICrypt. Exact types only, a subclass may override.
+inline std::unique_ptr<AEncryptMode> getSpecializedMode(CryptoMode mode, ICrypt* encryptor, std::vector<uint8_t>& IV) {
+	const std::type_info& type = typeid(*encryptor);
+	if (type == typeid(DESTableEncryptor))
+		return getMode(mode, static_cast<DESTableEncryptor*>(encryptor), IV);
+	if (type == typeid(DEALTableEncryptor))
+		return getMode(mode, static_cast<DEALTableEncryptor*>(encryptor), IV);
+	if (type == typeid(MARS))
+		return getMode(mode, static_cast<MARS*>(encryptor), IV);
+	if (type == typeid(SerpentBitslice))
+		return getMode(mode, static_cast<SerpentBitslice*>(encryptor), IV);
+	return getMode(mode, encryptor, IV);
+}
+
 class EncryptorManager {
 private:
+	// declared first so that it outlives kernelMode, whose prefetch thread uses it
+	std::shared_ptr<ICrypt> encryptor;
 	std::unique_ptr<AEncryptMode> kernelMode;
+	// kernelMode when it authenticates (GCM), otherwise nullptr
+	IAuthenticatedMode* authenticator = nullptr;
 	std::unique_ptr<IPadding> padding;
+	std::shared_ptr<ThreadPool> pool;
 	int blockLength;
-	ICrypt* encryptor;
+
+	// streaming state: the bytes of a block not yet handed to the mode. When
+	// decrypting the last full block is held back too, final() unpads it.
+	StreamDirection streamDirection = StreamDirection::Encrypt;
+	bool streamOpen = false;
+	uint8_t tail[MAX_BLOCK_LENGTH];
+	size_t tailSize = 0;
+
+	void processStream(const uint8_t* in, uint8_t* out, size_t blocksCount) {
+		if (streamDirection == StreamDirection::Encrypt)
+			kernelMode->encryptStream(in, out, blocksCount);
+		else
+			kernelMode->decryptStream(in, out, blocksCount);
+	}
+
+	// Pads the used bytes after the last whole block in place; returns the length
+	// of the padded tail (0 or blockLength).
+	size_t pad(uint8_t* block, size_t used) {
+		CRYPTO_STAGE(CryptoStage::Padding, used, 0);
+		return padding->padTail(block, used, blockLength);
+	}
+
+	// Strips the padding off the end of data by shrinking it; only the last
+	// block is looked at, as in final().
+	void unpad(std::vector<uint8_t>& data) {
+		size_t last = std::min(data.size(), static_cast<size_t>(blockLength));
+		CRYPTO_STAGE(CryptoStage::Padding, last, 0);
+		data.resize(data.size() - padding->paddingLength(data.data() + data.size() - last, last));
+	}
+
+	void checkCiphertextLength(size_t size) {
+		if (size % blockLength != 0)
+			throw std::invalid_argument("Ciphertext length is not a multiple of the block length");
+	}
+
+	// The bytes after the last whole block, encrypted into out; returns how many
+	// were written. Padded to a block, except with an authenticated mode (GCM),
+	// whose ciphertext is exactly as long as the plaintext.
+	size_t encryptTail(uint8_t* block, size_t used, uint8_t* out) {
+		if (authenticator != nullptr) {
+			if (used != 0)
+				authenticator->encryptTail(block, out, used);
+			return used;
+		}
+		size_t padded = pad(block, used);
+		kernelMode->encryptStream(block, out, padded / blockLength);
+		return padded;
+	}
+
+	// The end of the ciphertext, at most one block, still padded if the mode pads.
+	void decryptTail(const uint8_t* block, size_t size, uint8_t* out) {
+		if (size == 0)
+			return;
+		if (authenticator != nullptr && size != static_cast<size_t>(blockLength)) {
+			authenticator->decryptTail(block, out, size);
+			return;
+		}
+		checkCiphertextLength(size);
+		kernelMode->decryptStream(block, out, 1);
+	}
+
+	IAuthenticatedMode& checkAuthenticated() {
+		if (authenticator == nullptr)
+			throw std::logic_error("the mode does not authenticate");
+		return *authenticator;
+	}
+
+	std::vector<uint8_t> decryptPadded(const std::vector<uint8_t>& ciphertext) {
+		checkCiphertextLength(ciphertext.size());
+		std::vector<uint8_t> result(ciphertext.size());
+		kernelMode->restart();
+		kernelMode->decryptStream(ciphertext.data(), result.data(), ciphertext.size() / blockLength);
+		return result;
+	}
+
+	void checkStreamOpen() {
+		if (!streamOpen)
+			throw std::logic_error("begin() must be called before update() and final()");
+	}
 public:
 	EncryptorManager(std::vector<uint8_t>& key,
 					EncryptionAlgorithm algorithm,
 					CryptoMode mode,
 					Pudding padd,
-					std::vector<uint8_t>& IV){
+					std::vector<uint8_t>& IV,
+					CipherBackend backend = CipherBackend::Reference){
 		
-		switch (algorithm) {
-			case(EncryptionAlgorithm::DES):
-				encryptor = new DESEncryptor();
-				break;
-			case(EncryptionAlgorithm::MARS):
-				encryptor = new MARS();
-				break;
-			case(EncryptionAlgorithm::SERPENT):
-				encryptor = new Serpent();
-				break;
-			default:
-				throw std::exception("whong algorithm");
+		encryptor.reset(makeCipher(algorithm, backend));
+		{
+			CRYPTO_STAGE(CryptoStage::KeyExpansion, key.size(), 0);
+			encryptor->setKey(key);
 		}
+		kernelMode = getSpecializedMode(mode, encryptor.get(), IV);
+		authenticator = dynamic_cast<IAuthenticatedMode*>(kernelMode.get());
+		padding = getPadding(padd);
+		blockLength = encryptor->getBlockLength();
+	}
 
-		kernelMode = getMode(mode, encryptor->setKey(key), IV);
+	// Uses an engine that is already keyed, e.g. from KeyScheduleCache; the
+	// engine may be shared with other managers.
+	EncryptorManager(std::shared_ptr<ICrypt> keyedCipher,
+					CryptoMode mode,
+					Pudding padd,
+					std::vector<uint8_t>& IV)
+		: encryptor(std::move(keyedCipher)) {
+
+		kernelMode = getSpecializedMode(mode, encryptor.get(), IV);
+		authenticator = dynamic_cast<IAuthenticatedMode*>(kernelMode.get());
 		padding = getPadding(padd);
 		blockLength = encryptor->getBlockLength();
 	}
 
+	// Starts over with a new IV, dropping any stream in progress. Cheap: the key
+	// schedule and the mode object are kept.
+	EncryptorManager& setIV(const std::vector<uint8_t>& IV) {
+		kernelMode->setIV(IV);
+		streamOpen = false;
+		tailSize = 0;
+		return *this;
+	}
+
+	// Back to the state of a freshly built manager on the same engine: zero IV,
+	// no AAD, no stream in progress, keystream prefetch off. Only setParallel is
+	// kept. GCM gets no nonce at all, so it cannot encrypt before setIV(). For
+	// handing the manager on to someone else, as SessionPool does.
+	EncryptorManager& reset() {
+		setIV(std::vector<uint8_t>(blockLength));
+		if (authenticator != nullptr) {
+			authenticator->setAAD({});
+			authenticator->discardNonce();
+		}
+		kernelMode->setPrefetch(0);
+		return *this;
+	}
+
+	// Spreads ECB, CTR, RandomDelta and CBC/CFB decryption over threads;
+	// threads <= 1 restores the serial path.
+	// Output is byte-identical either way.
+	EncryptorManager& setParallel(unsigned threads, size_t minChunkBlocks = DEFAULT_MIN_CHUNK_BLOCKS) {
+		return setParallel(threads > 1 ? std::make_shared<ThreadPool>(threads) : nullptr, minChunkBlocks);
+	}
+
+	EncryptorManager& setParallel(std::shared_ptr<ThreadPool> threadPool, size_t minChunkBlocks = DEFAULT_MIN_CHUNK_BLOCKS) {
+		pool = std::move(threadPool);
+		kernelMode->setParallel(pool.get(), minChunkBlocks);
+		return *this;
+	}
+
+	// OFB and CTR only: a background thread keeps up to blocks of keystream ready,
+	// so encrypting the next data is a XOR as long as it lasts and the thread
+	// catches up between messages; 0 turns it off. It only helps a stream kept
+	// open across messages (begin() once, update() per message). A fresh IV per
+	// message discards the ring, so per-message IVs gain nothing. Output is
+	// byte-identical either way.
+	EncryptorManager& setKeystreamPrefetch(size_t blocks) {
+		kernelMode->setPrefetch(blocks);
+		return *this;
+	}
+
+	KeystreamStats getKeystreamStats() {
+		return kernelMode->getPrefetchStats();
+	}
+
+	// Incremental interface for data that does not fit in memory: begin() starts
+	// from the IV, update() takes chunks of any size and returns the output that
+	// is ready, final() pads (or unpads) the tail. Output matches encrypt/decrypt
+	// on the concatenated input. One-shot calls in between restart the chain.
+	EncryptorManager& begin(StreamDirection direction) {
+		kernelMode->restart();
+		streamDirection = direction;
+		streamOpen = true;
+		tailSize = 0;
+		return *this;
+	}
+
+	// out needs room for size + blockLength bytes; returns the bytes written.
+	size_t update(const uint8_t* data, size_t size, uint8_t* out) {
+		checkStreamOpen();
+		size_t length = static_cast<size_t>(blockLength);
+		size_t available = tailSize + size;
+		size_t blocksCount = streamDirection == StreamDirection::Encrypt
+			? available / length
+			: (available == 0 ? 0 : (available - 1) / length);
+		size_t written = 0;
+
+		if (tailSize != 0 && blocksCount != 0) {
+			size_t take = length - tailSize;
+			std::copy(data, data + take, tail + tailSize);
+			processStream(tail, out, 1);
+			data += take;
+			size -= take;
+			written += length;
+			tailSize = 0;
+			--blocksCount;
+		}
+
+		processStream(data, out + written, blocksCount);
+		data += blocksCount * length;
+		size -= blocksCount * length;
+		written += blocksCount * length;
+
+		std::copy(data, data + size, tail + tailSize);
+		tailSize += size;
+		return written;
+	}
+
+	std::vector<uint8_t> update(const std::vector<uint8_t>& data) {
+		std::vector<uint8_t> result(data.size() + blockLength);
+		result.resize(update(data.data(), data.size(), result.data()));
+		return result;
+	}
+
+	// out needs room for blockLength bytes; returns the bytes written. With GCM
+	// the plaintext streamed out so far is unauthenticated: it must not be used
+	// until verifyTag() accepts the tag.
+	size_t final(uint8_t* out) {
+		auto result = final();
+		std::copy(result.begin(), result.end(), out);
+		return result.size();
+	}
+
+	std::vector<uint8_t> final() {
+		checkStreamOpen();
+		streamOpen = false;
+		size_t used = tailSize;
+		tailSize = 0;
+
+		if (streamDirection == StreamDirection::Encrypt) {
+			std::vector<uint8_t> result(blockLength);
+			result.resize(encryptTail(tail, used, result.data()));
+			return result;
+		}
+
+		std::vector<uint8_t> result(used);
+		decryptTail(tail, used, result.data());
+		// no data at all is unpadded as well, so it fails like decrypt() does
+		if (authenticator == nullptr)
+			unpad(result);
+		return result;
+	}
+
+	// Per-stage totals over every thread since start (or resetInstrumentation());
+	// all zero unless built with CRYPTO_INSTRUMENTATION.
+	static InstrumentationSnapshot stageCounters() {
+		return instrumentationSnapshot();
+	}
+
+	int getBlockLength() const {
+		return blockLength;
+	}
+
+	// The whole blocks are read straight from data, only the tail is copied.
 	std::vector<uint8_t> encrypt(std::vector<uint8_t>& data) {
-		auto dataPadding = padding->makePadding(data, blockLength);
-		return kernelMode->encrypt(dataPadding);
+		size_t blocksCount = data.size() / blockLength;
+		size_t body = blocksCount * blockLength;
+		uint8_t last[MAX_BLOCK_LENGTH];
+		std::copy(data.begin() + body, data.end(), last);
 
+		std::vector<uint8_t> result(body + blockLength);
+		kernelMode->restart();
+		kernelMode->encryptStream(data.data(), result.data(), blocksCount);
+		result.resize(body + encryptTail(last, data.size() - body, result.data() + body));
+		return result;
 	}
-		
+
+	// Not for authenticated modes, which decrypt only together with the tag.
 	std::vector<uint8_t> decrypt(std::vector<uint8_t>& ciphertext) {
-		
-		auto data = kernelMode->decrypt(ciphertext);
-		return padding->undoPadding(data);
-		
+		if (authenticator != nullptr)
+			throw std::logic_error("the mode authenticates: decrypt needs the tag");
+		std::vector<uint8_t> result = decryptPadded(ciphertext);
+		unpad(result);
+		return result;
 	}
-	~EncryptorManager(){
-		delete encryptor;
+
+	// Authenticated modes (GCM) only. The tag covers aad and the ciphertext; aad
+	// applies from the next begin(), encrypt() or decrypt() on and stays until
+	// replaced. These modes ignore the padding: the ciphertext is as long as the
+	// plaintext. Each IV encrypts one message; encrypting again before the next
+	// setIV() throws std::logic_error.
+	EncryptorManager& setAAD(const std::vector<uint8_t>& aad) {
+		checkAuthenticated().setAAD(aad);
+		return *this;
+	}
+
+	// Tag of the last encrypt() or decrypt(), or of the stream since begin();
+	// after final() it covers the whole message.
+	std::vector<uint8_t> getTag() {
+		return checkAuthenticated().getTag();
+	}
+
+	// Constant-time comparison with getTag().
+	bool verifyTag(const std::vector<uint8_t>& tag) {
+		std::vector<uint8_t> expected = checkAuthenticated().getTag();
+		if (tag.size() != expected.size())
+			return false;
+		uint8_t difference = 0;
+		for (size_t i = 0; i < tag.size(); ++i)
+			difference |= tag[i] ^ expected[i];
+		return difference == 0;
+	}
+
+	// Checks the tag before anything is returned.
+	std::vector<uint8_t> decrypt(std::vector<uint8_t>& ciphertext, const std::vector<uint8_t>& tag) {
+		checkAuthenticated();
+		size_t blocksCount = ciphertext.size() / blockLength;
+		size_t body = blocksCount * blockLength;
+		std::vector<uint8_t> result(ciphertext.size());
+		kernelMode->restart();
+		kernelMode->decryptStream(ciphertext.data(), result.data(), blocksCount);
+		decryptTail(ciphertext.data() + body, ciphertext.size() - body, result.data() + body);
+		if (!verifyTag(tag))
+			throw std::invalid_argument("Authentication tag mismatch");
+		return result;
 	}
 };
@@ -14,41 +14,39 @@ ICrypt* FeistelNetwork::setKey(std::vector<uint8_t>& key) {
     return this;
 }
 
-std::vector<uint8_t> FeistelNetwork::encrypt(const std::vector<uint8_t>& data) {
-    size_t half = data.size() / 2;
-    std::vector<uint8_t> left(data.begin(), data.begin() + half);
-    std::vector<uint8_t> right(data.begin() + half, data.end());
+void FeistelNetwork::encryptBlock(const uint8_t* in, uint8_t* out) {
+    ScratchScope scratch;
+    size_t half = blockLength / 2;
+    ScratchBytes left(in, in + half, scratch.resource());
+    ScratchBytes right(in + half, in + blockLength, scratch.resource());
 
     for (int i = 0; i < rounds - 1; i++) {
         auto tmp = xorBits(left, encryptConversion->encode(right, rKeys[i]));
         left = right;
-        right = tmp;
+        right = std::move(tmp);
     }
 
     left = xorBits(left, encryptConversion->encode(right, rKeys[rounds - 1]));
 
-    std::vector<uint8_t> encryptedBlock(data.size());
-    std::copy(left.begin(), left.end(), encryptedBlock.begin());
-    std::copy(right.begin(), right.end(), encryptedBlock.begin() + half);
-    return encryptedBlock;
+    std::copy(left.begin(), left.end(), out);
+    std::copy(right.begin(), right.end(), out + half);
 }
 
-std::vector<uint8_t> FeistelNetwork::decrypt(const std::vector<uint8_t>& data) {
-    size_t half = data.size() / 2;
-    std::vector<uint8_t> left(data.begin(), data.begin() + half);
-    std::vector<uint8_t> right(data.begin() + half, data.end());
+void FeistelNetwork::decryptBlock(const uint8_t* in, uint8_t* out) {
+    ScratchScope scratch;
+    size_t half = blockLength / 2;
+    ScratchBytes left(in, in + half, scratch.resource());
+    ScratchBytes right(in + half, in + blockLength, scratch.resource());
 
     left = xorBits(left, encryptConversion->encode(right, rKeys[rounds - 1]));
     for (int i = rounds - 2; i >= 0; --i) {
         auto tmp = xorBits(right, encryptConversion->encode(left, rKeys[i]));
         right = left;
-        left = tmp;
+        left = std::move(tmp);
     }
 
-    std::vector<uint8_t> decryptedBlock(data.size());
-    std::copy(left.begin(), left.end(), decryptedBlock.begin());
-    std::copy(right.begin(), right.end(), decryptedBlock.begin() + half);
-    return decryptedBlock;
+    std::copy(left.begin(), left.end(), out);
+    std::copy(right.begin(), right.end(), out + half);
 }
 
 int FeistelNetwork::getBlockLength() {
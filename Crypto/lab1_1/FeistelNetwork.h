@@ -18,7 +18,7 @@ public:
         int rounds);
 
     ICrypt* setKey(std::vector<uint8_t>& key) override;
-    virtual std::vector<uint8_t> encrypt(const std::vector<uint8_t>& data) override;
-    virtual std::vector<uint8_t> decrypt(const std::vector<uint8_t>& data) override;
+    virtual void encryptBlock(const uint8_t* in, uint8_t* out) override;
+    virtual void decryptBlock(const uint8_t* in, uint8_t* out) override;
     virtual int getBlockLength() override;
 };
\ No newline at end of file
@@ -0,0 +1,251 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "Operations.h"
+
+// The carry-less multiply kernel is always built on x64, without global flags:
+// MSVC accepts PCLMULQDQ intrinsics anywhere, GCC and Clang only in functions
+// marked GHASH_PCLMUL_TARGET. It is only used when CPUID reports PCLMULQDQ and
+// SSE4.1, which the target lets the compiler use as well.
+#if defined(_M_X64) || defined(__x86_64__)
+#define GHASH_PCLMUL 1
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#if defined(_MSC_VER)
+#define GHASH_PCLMUL_TARGET
+#include <intrin.h>
+#else
+#define GHASH_PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#include <cpuid.h>
+#endif
+#endif
+
+enum class GHashLevel {
+    Table,
+    Pclmul
+};
+
+inline GHashLevel detectGHashLevel() {
+#if defined(GHASH_PCLMUL)
+    unsigned ecx = 0;
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    ecx = static_cast<unsigned>(info[2]);
+#else
+    unsigned a, b, d;
+    __cpuid(1, a, b, ecx, d);
+#endif
+    if ((ecx & (1u << 1)) && (ecx & (1u << 19))) {
+        return GHashLevel::Pclmul;
+    }
+#endif
+    return GHashLevel::Table;
+}
+
+inline GHashLevel ghashLevel() {
+    static const GHashLevel level = detectGHashLevel();
+    return level;
+}
+
+// GHASH of GCM (NIST SP 800-38D) under one hash key H. Blocks are 128-bit
+// big-endian values kept as a high and a low word. The portable path is Shoup's
+// 4-bit table; the PCLMULQDQ one folds four blocks per reduction with H..H^4.
+class GHash {
+private:
+    static constexpr int AGGREGATE = 4;
+
+    uint64_t tableHigh[16];
+    uint64_t tableLow[16];
+    // powers[i] = H^(i + 1)
+    uint64_t powers[AGGREGATE][2];
+    uint64_t stateHigh = 0;
+    uint64_t stateLow = 0;
+    GHashLevel level = ghashLevel();
+
+    // x^4 * r mod P for the four bits shifted out of the low end, pre-shifted by 48
+    static uint64_t reduction(size_t bits) {
+        static const uint16_t LAST4[16] = {
+            0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+            0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0 };
+        return static_cast<uint64_t>(LAST4[bits]) << 48;
+    }
+
+    static uint8_t byteAt(uint64_t high, uint64_t low, int i) {
+        return static_cast<uint8_t>(i < 8 ? high >> (56 - 8 * i) : low >> (120 - 8 * i));
+    }
+
+    // z = z * x^4 + nibble * H
+    void shiftAdd(uint64_t& zHigh, uint64_t& zLow, int nibble) const {
+        size_t rem = zLow & 0xF;
+        zLow = (zHigh << 60) | (zLow >> 4);
+        zHigh = (zHigh >> 4) ^ reduction(rem) ^ tableHigh[nibble];
+        zLow ^= tableLow[nibble];
+    }
+
+    // (high, low) *= H through the table, Horner over the nibbles from x^124 down
+    void multiplyTable(uint64_t& high, uint64_t& low) const {
+        uint64_t zHigh = 0;
+        uint64_t zLow = 0;
+        for (int i = 15; i >= 0; --i) {
+            uint8_t byte = byteAt(high, low, i);
+            shiftAdd(zHigh, zLow, byte & 0xF);
+            shiftAdd(zHigh, zLow, byte >> 4);
+        }
+        high = zHigh;
+        low = zLow;
+    }
+
+#if defined(GHASH_PCLMUL)
+    GHASH_PCLMUL_TARGET static __m128i toVector(uint64_t high, uint64_t low) {
+        return _mm_set_epi64x(static_cast<long long>(high), static_cast<long long>(low));
+    }
+
+    GHASH_PCLMUL_TARGET static __m128i load(const uint8_t* block) {
+        return toVector(bytesToUint64(block), bytesToUint64(block + 8));
+    }
+
+    // 256-bit carry-less product of a and b, accumulated into (low, high)
+    GHASH_PCLMUL_TARGET static void multiplyAdd(__m128i a, __m128i b, __m128i& low, __m128i& high) {
+        __m128i middle = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+        low = _mm_xor_si128(low, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x00), _mm_slli_si128(middle, 8)));
+        high = _mm_xor_si128(high, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x11), _mm_srli_si128(middle, 8)));
+    }
+
+    // GCM's bit order is reflected, so the product is one bit short: shift the 256
+    // bits left by one, then reduce modulo x^128 + x^7 + x^2 + x + 1.
+    GHASH_PCLMUL_TARGET static __m128i reduce(__m128i low, __m128i high) {
+        __m128i carryLow = _mm_srli_epi32(low, 31);
+        __m128i carryHigh = _mm_srli_epi32(high, 31);
+        low = _mm_slli_epi32(low, 1);
+        high = _mm_slli_epi32(high, 1);
+        high = _mm_or_si128(high, _mm_srli_si128(carryLow, 12));
+        high = _mm_or_si128(high, _mm_slli_si128(carryHigh, 4));
+        low = _mm_or_si128(low, _mm_slli_si128(carryLow, 4));
+
+        __m128i fold = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(low, 31), _mm_slli_epi32(low, 30)),
+            _mm_slli_epi32(low, 25));
+        __m128i spill = _mm_srli_si128(fold, 4);
+        low = _mm_xor_si128(low, _mm_slli_si128(fold, 12));
+        __m128i back = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(low, 1), _mm_srli_epi32(low, 2)),
+            _mm_srli_epi32(low, 7));
+        back = _mm_xor_si128(back, spill);
+        return _mm_xor_si128(high, _mm_xor_si128(low, back));
+    }
+
+    GHASH_PCLMUL_TARGET void updatePclmul(const uint8_t* data, size_t blocks) {
+        __m128i state = toVector(stateHigh, stateLow);
+        __m128i h[AGGREGATE];
+        for (int i = 0; i < AGGREGATE; ++i) {
+            h[i] = toVector(powers[i][0], powers[i][1]);
+        }
+
+        size_t i = 0;
+        for (; i + AGGREGATE <= blocks; i += AGGREGATE) {
+            const uint8_t* block = data + 16 * i;
+            __m128i low = _mm_setzero_si128();
+            __m128i high = _mm_setzero_si128();
+            multiplyAdd(_mm_xor_si128(state, load(block)), h[3], low, high);
+            multiplyAdd(load(block + 16), h[2], low, high);
+            multiplyAdd(load(block + 32), h[1], low, high);
+            multiplyAdd(load(block + 48), h[0], low, high);
+            state = reduce(low, high);
+        }
+        for (; i < blocks; ++i) {
+            __m128i low = _mm_setzero_si128();
+            __m128i high = _mm_setzero_si128();
+            multiplyAdd(_mm_xor_si128(state, load(data + 16 * i)), h[0], low, high);
+            state = reduce(low, high);
+        }
+
+        stateLow = static_cast<uint64_t>(_mm_cvtsi128_si64(state));
+        stateHigh = static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(state, state)));
+    }
+#endif
+
+public:
+    GHash() {
+        uint8_t zero[16] = {};
+        setKey(zero);
+    }
+
+    void setKey(const uint8_t* h) {
+        uint64_t high = bytesToUint64(h);
+        uint64_t low = bytesToUint64(h + 8);
+
+        // tables[i] = i * H, with bit 3 of i standing for x^0
+        tableHigh[0] = tableLow[0] = 0;
+        tableHigh[8] = high;
+        tableLow[8] = low;
+        for (int i = 4; i > 0; i >>= 1) {
+            uint64_t carry = (low & 1) ? 0xE100000000000000ull : 0;
+            low = (high << 63) | (low >> 1);
+            high = (high >> 1) ^ carry;
+            tableHigh[i] = high;
+            tableLow[i] = low;
+        }
+        for (int i = 2; i <= 8; i <<= 1) {
+            for (int j = 1; j < i; ++j) {
+                tableHigh[i + j] = tableHigh[i] ^ tableHigh[j];
+                tableLow[i + j] = tableLow[i] ^ tableLow[j];
+            }
+        }
+
+        powers[0][0] = bytesToUint64(h);
+        powers[0][1] = bytesToUint64(h + 8);
+        for (int i = 1; i < AGGREGATE; ++i) {
+            powers[i][0] = powers[i - 1][0];
+            powers[i][1] = powers[i - 1][1];
+            multiplyTable(powers[i][0], powers[i][1]);
+        }
+        reset();
+    }
+
+    // Caps the kernel, e.g. to compare the table with PCLMULQDQ on one machine.
+    // Levels the CPU lacks are never selected.
+    GHash& setLevel(GHashLevel value) {
+        level = std::min(value, ghashLevel());
+        return *this;
+    }
+
+    GHashLevel getLevel() const {
+        return level;
+    }
+
+    void reset() {
+        stateHigh = 0;
+        stateLow = 0;
+    }
+
+    // Whole 16-byte blocks.
+    void update(const uint8_t* data, size_t blocks) {
+#if defined(GHASH_PCLMUL)
+        if (level == GHashLevel::Pclmul) {
+            updatePclmul(data, blocks);
+            return;
+        }
+#endif
+        for (size_t i = 0; i < blocks; ++i) {
+            stateHigh ^= bytesToUint64(data + 16 * i);
+            stateLow ^= bytesToUint64(data + 16 * i + 8);
+            multiplyTable(stateHigh, stateLow);
+        }
+    }
+
+    // Any length; a partial last block is padded with zeros.
+    void updatePadded(const uint8_t* data, size_t length) {
+        update(data, length / 16);
+        if (length % 16 != 0) {
+            uint8_t last[16] = {};
+            std::copy(data + length - length % 16, data + length, last);
+            update(last, 1);
+        }
+    }
+
+    // 16 bytes.
+    void digest(uint8_t* out) const {
+        uint64ToBytes(stateHigh, out);
+        uint64ToBytes(stateLow, out + 8);
+    }
+};
@@ -0,0 +1,235 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+// Per-stage counters for finding where the time goes. Only a build that
+// defines CRYPTO_INSTRUMENTATION counts anything; everywhere else CRYPTO_STAGE
+// expands to nothing (its arguments are not evaluated) and snapshots are all zero.
+//
+// Each thread writes its own counters without locking; instrumentationSnapshot()
+// sums every live thread plus the ones that have exited. Time is exclusive: a
+// stage nested inside another (the cipher inside a mode) is subtracted from the
+// outer one, and so is the time a parallelFor caller sleeps until the pool's
+// workers finish (CRYPTO_IDLE), since the workers count those chunks as their
+// own stages. The stages then add up to the CPU time spent in the library over
+// all threads, which with a pool is more than the wall time. Chaining modes call
+// the cipher one block at a time, so an instrumented build pays two clock reads
+// per block there.
+
+enum class CryptoStage {
+    KeyExpansion,
+    Padding,
+    Mode,
+    Cipher,
+    Authentication,
+    Count
+};
+
+struct StageCounters {
+    uint64_t nanoseconds = 0;
+    uint64_t bytes = 0;
+    uint64_t blocks = 0;
+    uint64_t calls = 0;
+};
+
+struct InstrumentationSnapshot {
+    std::array<StageCounters, static_cast<size_t>(CryptoStage::Count)> stages;
+
+    const StageCounters& operator[](CryptoStage stage) const {
+        return stages[static_cast<size_t>(stage)];
+    }
+};
+
+inline const char* cryptoStageName(CryptoStage stage) {
+    switch (stage) {
+    case CryptoStage::KeyExpansion: return "key expansion";
+    case CryptoStage::Padding: return "padding";
+    case CryptoStage::Mode: return "mode";
+    case CryptoStage::Cipher: return "cipher";
+    case CryptoStage::Authentication: return "authentication";
+    default: return "?";
+    }
+}
+
+#ifdef CRYPTO_INSTRUMENTATION
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+constexpr bool INSTRUMENTATION_ENABLED = true;
+
+namespace instrumentation {
+
+    constexpr size_t STAGES = static_cast<size_t>(CryptoStage::Count);
+
+    struct ThreadCounters;
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<ThreadCounters*> live;
+        InstrumentationSnapshot exited;
+
+        static Registry& get() {
+            static Registry registry;
+            return registry;
+        }
+    };
+
+    // Written only by the owning thread; relaxed atomics keep the concurrent
+    // reads in snapshot() race-free at the price of a plain store on x86.
+    struct ThreadCounters {
+        std::atomic<uint64_t> values[STAGES][4] = {};
+
+        ThreadCounters() {
+            Registry& registry = Registry::get();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.live.push_back(this);
+        }
+
+        ~ThreadCounters() {
+            Registry& registry = Registry::get();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            addTo(registry.exited);
+            registry.live.erase(std::find(registry.live.begin(), registry.live.end(), this));
+        }
+
+        void add(CryptoStage stage, uint64_t nanoseconds, uint64_t bytes, uint64_t blocks) {
+            auto& counters = values[static_cast<size_t>(stage)];
+            const uint64_t deltas[4] = { nanoseconds, bytes, blocks, 1 };
+            for (int i = 0; i < 4; ++i) {
+                counters[i].store(counters[i].load(std::memory_order_relaxed) + deltas[i], std::memory_order_relaxed);
+            }
+        }
+
+        void addTo(InstrumentationSnapshot& snapshot) const {
+            for (size_t s = 0; s < STAGES; ++s) {
+                snapshot.stages[s].nanoseconds += values[s][0].load(std::memory_order_relaxed);
+                snapshot.stages[s].bytes += values[s][1].load(std::memory_order_relaxed);
+                snapshot.stages[s].blocks += values[s][2].load(std::memory_order_relaxed);
+                snapshot.stages[s].calls += values[s][3].load(std::memory_order_relaxed);
+            }
+        }
+
+        void reset() {
+            for (auto& stage : values) {
+                for (auto& value : stage) {
+                    value.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        static ThreadCounters& local() {
+            thread_local ThreadCounters counters;
+            return counters;
+        }
+    };
+
+    class StageScope {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        CryptoStage stage;
+        uint64_t bytes;
+        uint64_t blocks;
+        Clock::time_point start;
+        uint64_t nestedNanoseconds = 0;
+        StageScope* parent;
+
+        static StageScope*& current() {
+            thread_local StageScope* scope = nullptr;
+            return scope;
+        }
+
+        friend class IdleScope;
+
+    public:
+        StageScope(CryptoStage stage, uint64_t bytes, uint64_t blocks)
+            : stage(stage), bytes(bytes), blocks(blocks), start(Clock::now()), parent(current()) {
+            current() = this;
+        }
+
+        StageScope(const StageScope&) = delete;
+        StageScope& operator=(const StageScope&) = delete;
+
+        ~StageScope() {
+            uint64_t elapsed = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+            ThreadCounters::local().add(stage, elapsed - std::min(elapsed, nestedNanoseconds), bytes, blocks);
+            if (parent) {
+                parent->nestedNanoseconds += elapsed;
+            }
+            current() = parent;
+        }
+    };
+
+    // Time the enclosing stage spends blocked on other threads; it is taken out
+    // of that stage and counted nowhere.
+    class IdleScope {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        Clock::time_point start;
+        StageScope* parent;
+
+    public:
+        IdleScope() : start(Clock::now()), parent(StageScope::current()) {
+        }
+
+        IdleScope(const IdleScope&) = delete;
+        IdleScope& operator=(const IdleScope&) = delete;
+
+        ~IdleScope() {
+            if (parent) {
+                parent->nestedNanoseconds += static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+            }
+        }
+    };
+}
+
+#define CRYPTO_STAGE_CONCAT2(a, b) a##b
+#define CRYPTO_STAGE_CONCAT(a, b) CRYPTO_STAGE_CONCAT2(a, b)
+#define CRYPTO_STAGE(stage, bytes, blocks) \
+    ::instrumentation::StageScope CRYPTO_STAGE_CONCAT(cryptoStageScope, __LINE__)( \
+        (stage), static_cast<uint64_t>(bytes), static_cast<uint64_t>(blocks))
+#define CRYPTO_IDLE() \
+    ::instrumentation::IdleScope CRYPTO_STAGE_CONCAT(cryptoIdleScope, __LINE__)
+
+inline InstrumentationSnapshot instrumentationSnapshot() {
+    instrumentation::Registry& registry = instrumentation::Registry::get();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    InstrumentationSnapshot snapshot = registry.exited;
+    for (const auto* counters : registry.live) {
+        counters->addTo(snapshot);
+    }
+    return snapshot;
+}
+
+// Not synchronized with threads that are inside a stage right now; call between runs.
+inline void resetInstrumentation() {
+    instrumentation::Registry& registry = instrumentation::Registry::get();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.exited = InstrumentationSnapshot();
+    for (auto* counters : registry.live) {
+        counters->reset();
+    }
+}
+
+#else
+
+constexpr bool INSTRUMENTATION_ENABLED = false;
+
+#define CRYPTO_STAGE(stage, bytes, blocks) ((void)0)
+#define CRYPTO_IDLE() ((void)0)
+
+inline InstrumentationSnapshot instrumentationSnapshot() {
+    return InstrumentationSnapshot();
+}
+
+inline void resetInstrumentation() {
+}
+
+#endif
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include "EncryptorManager.h"
+
+struct KeyCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t size = 0;
+    size_t capacity = 0;
+};
+
+// Keyed engines shared between managers, so a key seen before skips setKey and
+// the whole key expansion. Engines only read their schedule while encrypting
+// (the parallel modes already rely on that), so one instance can serve any
+// number of managers and threads at once. Least recently used entries are
+// dropped beyond capacity; managers still holding one keep it alive.
+class KeyScheduleCache {
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<ICrypt>>;
+
+    mutable std::mutex mutex;
+    size_t capacity;
+    std::list<Entry> entries;   // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    KeyCacheStats stats;
+
+    static std::string makeId(EncryptionAlgorithm algorithm, CipherBackend backend, const std::vector<uint8_t>& key) {
+        std::string id;
+        id.reserve(key.size() + 2);
+        id.push_back(static_cast<char>(algorithm));
+        id.push_back(static_cast<char>(backend));
+        id.append(key.begin(), key.end());
+        return id;
+    }
+
+    std::shared_ptr<ICrypt> find(const std::string& id) {
+        auto found = index.find(id);
+        if (found == index.end()) {
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, found->second);
+        return found->second->second;
+    }
+
+public:
+    explicit KeyScheduleCache(size_t capacity = 4096) : capacity(capacity) {
+        if (capacity == 0) {
+            throw std::invalid_argument("Key cache capacity must be positive");
+        }
+    }
+
+    KeyScheduleCache(const KeyScheduleCache&) = delete;
+    KeyScheduleCache& operator=(const KeyScheduleCache&) = delete;
+
+    // Keyed engine for (algorithm, backend, key), expanding the key on a miss.
+    std::shared_ptr<ICrypt> get(EncryptionAlgorithm algorithm, CipherBackend backend, std::vector<uint8_t>& key) {
+        std::string id = makeId(algorithm, backend, key);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (auto cipher = find(id)) {
+                ++stats.hits;
+                return cipher;
+            }
+            ++stats.misses;
+        }
+
+        // expand outside the lock so hits on other keys are not held up
+        std::shared_ptr<ICrypt> cipher(makeCipher(algorithm, backend));
+        {
+            CRYPTO_STAGE(CryptoStage::KeyExpansion, key.size(), 0);
+            cipher->setKey(key);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        // another thread may have expanded the same key meanwhile
+        if (auto existing = find(id)) {
+            return existing;
+        }
+        entries.emplace_front(std::move(id), cipher);
+        index.emplace(entries.front().first, entries.begin());
+        if (entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+            ++stats.evictions;
+        }
+        return cipher;
+    }
+
+    KeyCacheStats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        KeyCacheStats result = stats;
+        result.size = entries.size();
+        result.capacity = capacity;
+        return result;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        index.clear();
+    }
+};
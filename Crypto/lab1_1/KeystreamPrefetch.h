@@ -0,0 +1,168 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include "CryptoInterfaces.h"
+#include "Operations.h"
+
+struct KeystreamStats {
+    uint64_t prefetchedBlocks = 0;  // served from the ring
+    uint64_t inlineBlocks = 0;      // generated on the caller's thread
+    uint64_t resets = 0;
+};
+
+// Keystream produced ahead of use by a background thread, for modes whose
+// keystream does not depend on the data (OFB, CTR). The ring holds the blocks
+// from one position on, produced from the feedback the mode had there: the
+// previous keystream block for OFB, the nonce for CTR. The thread sleeps while
+// the ring is full, so it only takes an otherwise idle core.
+//
+// One consumer: the mode that owns it. The generator must not touch the mode,
+// only what it captured (the keyed engine, which is read-only).
+class KeystreamPrefetcher {
+public:
+    // keystream blocks [position, position + count) into out; feedback is the
+    // state at position and is left at the state of position + count
+    using Generator = std::function<void(uint64_t position, uint8_t* feedback, uint8_t* out, size_t count)>;
+
+private:
+    static constexpr size_t PRODUCE_BLOCKS = 64;
+
+    const size_t blockLength;
+    // the feedback after a block is the block itself (OFB), otherwise it never changes (CTR)
+    const bool chained;
+    const size_t capacity;
+    Generator generate;
+    std::vector<uint8_t> ring;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    size_t head = 0;
+    size_t filled = 0;
+    uint64_t headPosition = 0;
+    uint8_t headFeedback[MAX_BLOCK_LENGTH] = {};
+    // where the worker continues: position and feedback after the last block in the ring
+    uint64_t tailPosition = 0;
+    uint8_t tailFeedback[MAX_BLOCK_LENGTH] = {};
+    uint64_t generation = 0;
+    bool active = false;
+    bool stopping = false;
+    KeystreamStats stats;
+    std::thread worker;
+
+    void workerLoop() {
+        std::vector<uint8_t> feedback(blockLength);
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [this] { return stopping || (active && filled < capacity); });
+            if (stopping) {
+                return;
+            }
+            // the free region up to the end of the ring; the consumer never reads it
+            size_t tail = (head + filled) % capacity;
+            size_t count = std::min({ PRODUCE_BLOCKS, capacity - filled, capacity - tail });
+            uint64_t position = tailPosition;
+            uint64_t started = generation;
+            std::copy(tailFeedback, tailFeedback + blockLength, feedback.begin());
+
+            lock.unlock();
+            generate(position, feedback.data(), ring.data() + tail * blockLength, count);
+            lock.lock();
+
+            if (generation == started) {
+                filled += count;
+                tailPosition += count;
+                std::copy(feedback.begin(), feedback.end(), tailFeedback);
+            }
+        }
+    }
+
+public:
+    KeystreamPrefetcher(int blockLen, size_t capacityBlocks, bool chainedFeedback, Generator generator)
+        : blockLength(static_cast<size_t>(blockLen)), chained(chainedFeedback), capacity(std::max<size_t>(capacityBlocks, 1)),
+        generate(std::move(generator)), ring(capacity * blockLength) {
+        worker = std::thread([this] { workerLoop(); });
+    }
+
+    KeystreamPrefetcher(const KeystreamPrefetcher&) = delete;
+    KeystreamPrefetcher& operator=(const KeystreamPrefetcher&) = delete;
+
+    ~KeystreamPrefetcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+    // The mode is now at position with feedback. Keeps the ring when it already
+    // starts there, otherwise drops it and has the worker start over.
+    void reset(uint64_t position, const uint8_t* feedback) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (active && headPosition == position && std::equal(feedback, feedback + blockLength, headFeedback)) {
+                return;
+            }
+            ++generation;
+            ++stats.resets;
+            active = true;
+            head = 0;
+            filled = 0;
+            headPosition = tailPosition = position;
+            std::copy(feedback, feedback + blockLength, headFeedback);
+            std::copy(feedback, feedback + blockLength, tailFeedback);
+        }
+        wake.notify_one();
+    }
+
+    // out = in ^ keystream for up to blocksCount blocks from position, which
+    // feedback belongs to; returns how many and leaves feedback at the state after
+    // them. in and out may be the same buffer.
+    size_t apply(uint64_t position, uint8_t* feedback, const uint8_t* in, uint8_t* out, size_t blocksCount) {
+        size_t start;
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!active || position != headPosition || !std::equal(feedback, feedback + blockLength, headFeedback)) {
+                return 0;
+            }
+            start = head;
+            count = std::min(filled, blocksCount);
+        }
+
+        // the worker does not write filled blocks, so they are read unlocked
+        size_t first = std::min(count, capacity - start);
+        xorBits(in, ring.data() + start * blockLength, out, first * blockLength);
+        xorBits(in + first * blockLength, ring.data(), out + first * blockLength, (count - first) * blockLength);
+
+        if (count != 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (chained) {
+                size_t last = (start + count - 1) % capacity;
+                std::copy(ring.begin() + last * blockLength, ring.begin() + (last + 1) * blockLength, headFeedback);
+                std::copy(headFeedback, headFeedback + blockLength, feedback);
+            }
+            head = (start + count) % capacity;
+            filled -= count;
+            headPosition += count;
+            stats.prefetchedBlocks += count;
+        }
+        wake.notify_one();
+        return count;
+    }
+
+    void addInline(size_t blocksCount) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.inlineBlocks += blocksCount;
+    }
+
+    KeystreamStats getStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+};
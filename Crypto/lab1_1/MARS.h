@@ -2,15 +2,24 @@
 #include "Operations.h"
 #include "CryptoInterfaces.h"
 #include "MARSConfig.h"
+#include <cstring>
+#include <memory>
+#include <tuple>
+
+// Expanded MARS key: words 0-3 and 36-39 are the whitening keys, 4-35 the core
+// round keys.
+struct alignas(64) MARSKeySchedule {
+    uint32_t words[40];
+};
 
 class KeyExpansion : public IExpandKey {
 
 
 public:
-	std::vector<std::vector<uint8_t>> expand(const std::vector<uint8_t>& key) override {
+	void expand(const std::vector<uint8_t>& key, MARSKeySchedule& schedule) {
 		size_t n = key.size() / 4;
-		std::vector<uint32_t> T(15);
-		std::vector<uint32_t> K(40);
+		uint32_t T[15] = {};
+		uint32_t* K = schedule.words;
 
 		for (int i = 0; i < n; ++i)
 		{
@@ -55,12 +64,17 @@ public:
 
             K[i] = w ^ (p & M);
         }
+	}
+
+	std::vector<std::vector<uint8_t>> expand(const std::vector<uint8_t>& key) override {
+        MARSKeySchedule schedule;
+        expand(key, schedule);
 
         std::vector<std::vector<uint8_t>> roundKeys(40);
 
         for (int i = 0; i < 40; ++i) {
             std::vector<uint8_t> bytes(4);
-            uint32_t value = K[i];
+            uint32_t value = schedule.words[i];
             bytes[0] = static_cast<uint8_t>(value & 0xFF);
             bytes[1] = static_cast<uint8_t>((value >> 8) & 0xFF);
             bytes[2] = static_cast<uint8_t>((value >> 16) & 0xFF);
@@ -78,8 +92,8 @@ public:
 
 class MARS :public ICrypt {
 private: 
-    std::vector<std::vector<uint8_t>> rKeys;
-    std::unique_ptr<IExpandKey> expandKey;
+    MARSKeySchedule schedule;
+    std::unique_ptr<KeyExpansion> expandKey;
 protected:
 
     std::tuple<uint32_t, uint32_t, uint32_t> EFunction(uint32_t A, uint32_t firstKey, uint32_t secondKey)
@@ -108,21 +122,15 @@ public:
 
     ICrypt* setKey(std::vector<uint8_t>& key) override
     {
-        rKeys = expandKey->expand(key);
+        expandKey->expand(key, schedule);
         return this;
     }
 
-    std::vector<uint8_t> encrypt(const std::vector<uint8_t>& data) override {
-        std::vector<uint32_t> K(40);
-        for (int i = 0; i < 40; ++i)
-        {
-            K[i] = toUInt32(rKeys[i], 0);
-        }
-
-        uint32_t A = toUInt32(data, 0) + K[0];
-        uint32_t B = toUInt32(data, 4) + K[1];
-        uint32_t C = toUInt32(data, 8) + K[2];
-        uint32_t D = toUInt32(data, 12) + K[3];
+    void encryptBlock(const uint8_t* in, uint8_t* out) override {
+        uint32_t A = toUInt32(in) + schedule.words[0];
+        uint32_t B = toUInt32(in + 4) + schedule.words[1];
+        uint32_t C = toUInt32(in + 8) + schedule.words[2];
+        uint32_t D = toUInt32(in + 12) + schedule.words[3];
 
         // Forward Mixing
         for (int i = 0; i < 8; i++)  
@@ -146,8 +154,8 @@ public:
         // Cryptographic core
         for (int i = 0; i < 16; i++)
         {
-            uint32_t firstKey = toUInt32(rKeys[2 * i + 5], 0);
-            uint32_t  secondKey = toUInt32(rKeys[2 * i + 4], 0);
+            uint32_t firstKey = schedule.words[2 * i + 5];
+            uint32_t  secondKey = schedule.words[2 * i + 4];
 
             uint32_t L, M, R;
             std::tie(L, M, R) = EFunction(A, firstKey, secondKey);
@@ -190,34 +198,22 @@ public:
             D = LeftRotate(temp, 24);
         }
 
-        A -= K[36];
-        B -= K[37];
-        C -= K[38];
-        D -= K[39];
-
-        std::vector<uint8_t> result(16);
-        std::memcpy(result.data(), &A, 4);
-        std::memcpy(result.data() + 4, &B, 4);
-        std::memcpy(result.data() + 8, &C, 4);
-        std::memcpy(result.data() + 12, &D, 4);
-
-        return result;
-
+        A -= schedule.words[36];
+        B -= schedule.words[37];
+        C -= schedule.words[38];
+        D -= schedule.words[39];
 
+        uint32ToBytes(A, out);
+        uint32ToBytes(B, out + 4);
+        uint32ToBytes(C, out + 8);
+        uint32ToBytes(D, out + 12);
     }
 
-    std::vector<uint8_t> decrypt(const std::vector<uint8_t>& data) override {
-        
-        std::vector<uint32_t> K(40);
-        for (int i = 0; i < 40; ++i)
-        {
-            K[i] = toUInt32(rKeys[i], 0);
-        }
-
-        uint32_t A = toUInt32(data, 0) + K[36];
-        uint32_t B = toUInt32(data, 4) + K[37];
-        uint32_t C = toUInt32(data, 8) + K[38];
-        uint32_t D = toUInt32(data, 12) + K[39];
+    void decryptBlock(const uint8_t* in, uint8_t* out) override {
+        uint32_t A = toUInt32(in) + schedule.words[36];
+        uint32_t B = toUInt32(in + 4) + schedule.words[37];
+        uint32_t C = toUInt32(in + 8) + schedule.words[38];
+        uint32_t D = toUInt32(in + 12) + schedule.words[39];
 
         // Inverse Backward Mixing
         for (int i = 7; i >= 0; i--)
@@ -245,8 +241,8 @@ public:
             B = A;
             A = tmp;
 
-            uint32_t firstKey = toUInt32(rKeys[2 * i + 5], 0);
-            uint32_t secondKey = toUInt32(rKeys[2 * i + 4], 0);
+            uint32_t firstKey = schedule.words[2 * i + 5];
+            uint32_t secondKey = schedule.words[2 * i + 4];
 
             uint32_t L, M, R;
             std::tie(L, M, R) = EFunction(A, firstKey, secondKey);
@@ -265,11 +261,11 @@ public:
         // Inverse Forward Mixing
         for (int i = 7; i >= 0; i--)
         {
-            uint32_t tmp = D;
-            D = C;
-            C = B;
-            B = A;
-            A = tmp;
+            uint32_t tmp = A;
+            A = B;
+            B = C;
+            C = D;
+            D = tmp;
 
             if (i == 1 || i == 5) A -= B;
             if (i == 0 || i == 4) A -= D;
@@ -281,18 +277,27 @@ public:
             B = (B - S1[RightRotate(A, 8) & 0xff]) ^ S0[A & 0xff];
         }
 
-        A -= K[0];
-        B -= K[1];
-        C -= K[2];
-        D -= K[3];
+        A -= schedule.words[0];
+        B -= schedule.words[1];
+        C -= schedule.words[2];
+        D -= schedule.words[3];
+
+        uint32ToBytes(A, out);
+        uint32ToBytes(B, out + 4);
+        uint32ToBytes(C, out + 8);
+        uint32ToBytes(D, out + 12);
+    }
 
-        std::vector<uint8_t> result(16);
-        std::memcpy(result.data(), &A, 4);
-        std::memcpy(result.data() + 4, &B, 4);
-        std::memcpy(result.data() + 8, &C, 4);
-        std::memcpy(result.data() + 12, &D, 4);
+    void encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            MARS::encryptBlock(in + i * 16, out + i * 16);
+        }
+    }
 
-        return result;
+    void decryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            MARS::decryptBlock(in + i * 16, out + i * 16);
+        }
     }
 
     int getBlockLength() override {
@@ -1,8 +1,12 @@
 #pragma once
 #include<vector>
+#include<memory_resource>
+#include<algorithm>
+#include<cstdint>
+#include<stdexcept>
 #include"DESConfig.h"
-inline std::vector<uint8_t> permuteBits(const std::vector<uint8_t>& data, const std::vector<uint16_t>& pBlock, bool reverseBitOrder = false, bool  isOneIndexed = true) {
-    std::vector<uint8_t> result((pBlock.size() + 7) / 8);
+inline void permuteBits(const uint8_t* data, uint8_t* result, const std::vector<uint16_t>& pBlock, bool reverseBitOrder = false, bool  isOneIndexed = true) {
+    std::fill(result, result + (pBlock.size() + 7) / 8, 0);
     int position, blockIndex, bitOffset, resOffset, resIndex;
 
     for (int dataBitIndex = 0; dataBitIndex < pBlock.size(); dataBitIndex++) {
@@ -14,16 +18,24 @@ inline std::vector<uint8_t> permuteBits(const std::vector<uint8_t>& data, const
 
         resIndex = dataBitIndex / 8;
 
-        bool value = static_cast<uint8_t>((data[blockIndex] & (1 << bitOffset)));
-        result[resIndex] = static_cast<uint8_t>(value
-            ? result[resIndex] | (1 << resOffset)
-            : result[resIndex] & ~(1 << resOffset));
-
+        if (data[blockIndex] & (1 << bitOffset)) {
+            result[resIndex] |= static_cast<uint8_t>(1 << resOffset);
+        }
     }
+}
 
+inline std::vector<uint8_t> permuteBits(const std::vector<uint8_t>& data, const std::vector<uint16_t>& pBlock, bool reverseBitOrder = false, bool  isOneIndexed = true) {
+    std::vector<uint8_t> result((pBlock.size() + 7) / 8);
+    permuteBits(data.data(), result.data(), pBlock, reverseBitOrder, isOneIndexed);
     return result;
 }
 
+inline void xorBits(const uint8_t* x, const uint8_t* y, uint8_t* result, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        result[i] = x[i] ^ y[i];
+    }
+}
+
 inline std::vector<uint8_t> xorBits(std::vector<uint8_t> x, std::vector<uint8_t> y) {
 
     size_t size = std::min(x.size(), y.size());
@@ -35,16 +47,23 @@ inline std::vector<uint8_t> xorBits(std::vector<uint8_t> x, std::vector<uint8_t>
     return res;
 }
 
-inline std::vector<uint8_t> substitution(std::vector<uint8_t>& data) {
-    if (data.size() != 6)
-        throw std::exception("key isnt 6 bytes");
-    std::vector<uint8_t> result(4);
+// Result lives on the same memory resource as x.
+template<class Bytes>
+inline std::pmr::vector<uint8_t> xorBits(const std::pmr::vector<uint8_t>& x, const Bytes& y) {
+    std::pmr::vector<uint8_t> res(std::min(x.size(), y.size()), x.get_allocator());
+    xorBits(x.data(), y.data(), res.data(), res.size());
+    return res;
+}
+
+// Six bytes (eight 6-bit groups) through S_BLOCKS into four bytes.
+inline void substitution(const uint8_t* data, uint8_t* result) {
+    std::fill(result, result + 4, 0);
     uint64_t tmpBlock = 0;
-    for (auto b : data) {
-        tmpBlock = (b & 0xFF) | (tmpBlock << 8);
+    for (int i = 0; i < 6; i++) {
+        tmpBlock = (data[i] & 0xFF) | (tmpBlock << 8);
     }
     for (int i = 0; i < 8; i++) {
-        std::vector<int> bitsArr(6);
+        int bitsArr[6];
         int sixBits = (int)((tmpBlock >> (6 * (8 - i - 1))) & 0xFF);
         for (int j = 0; j < 6; j++) {
             bitsArr[j] = (sixBits >> (5 - j)) & 1;
@@ -56,6 +75,21 @@ inline std::vector<uint8_t> substitution(std::vector<uint8_t>& data) {
 
         result[i / 2] |= uint8_t(((i & 1) != 0 ? value : value << 4));
     }
+}
+
+inline std::vector<uint8_t> substitution(std::vector<uint8_t>& data) {
+    if (data.size() != 6)
+        throw std::invalid_argument("key isnt 6 bytes");
+    std::vector<uint8_t> result(4);
+    substitution(data.data(), result.data());
+    return result;
+}
+
+inline std::pmr::vector<uint8_t> substitution(const std::pmr::vector<uint8_t>& data) {
+    if (data.size() != 6)
+        throw std::invalid_argument("key isnt 6 bytes");
+    std::pmr::vector<uint8_t> result(4, data.get_allocator());
+    substitution(data.data(), result.data());
     return result;
 }
 
@@ -96,6 +130,27 @@ inline uint32_t toUInt32(const std::vector<uint8_t>& bytes, size_t index) {
         (static_cast<uint32_t>(bytes[index + 3]) << 24);
 }
 
+inline uint32_t toUInt32(const uint8_t* bytes) {
+    return static_cast<uint32_t>(bytes[0]) |
+        (static_cast<uint32_t>(bytes[1]) << 8) |
+        (static_cast<uint32_t>(bytes[2]) << 16) |
+        (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+inline void uint32ToBytes(uint32_t value, uint8_t* bytes) {
+    bytes[0] = static_cast<uint8_t>(value);
+    bytes[1] = static_cast<uint8_t>(value >> 8);
+    bytes[2] = static_cast<uint8_t>(value >> 16);
+    bytes[3] = static_cast<uint8_t>(value >> 24);
+}
+
+inline void uint64ToBytes(uint64_t val, uint8_t* bytes) {
+    for (int i = 7; i >= 0; --i) {
+        bytes[i] = static_cast<uint8_t>(val & 0xFF);
+        val >>= 8;
+    }
+}
+
 inline std::vector<uint8_t> uint64ToBytes(uint64_t val) {
     std::vector<uint8_t> bytes(8);
     for (int i = 7; i >= 0; --i) {
@@ -105,10 +160,31 @@ inline std::vector<uint8_t> uint64ToBytes(uint64_t val) {
     return bytes;
 }
 
+inline uint64_t bytesToUint64(const uint8_t* bytes) {
+    uint64_t val = 0;
+    for (int i = 0; i < 8; ++i) {
+        val = (val << 8) | bytes[i];
+    }
+    return val;
+}
+
 inline uint64_t bytesToUint64(const std::vector<uint8_t>& bytes) {
     uint64_t val = 0;
     for (int i = 0; i < 8; ++i) {
         val = (val << 8) | bytes[i];
     }
     return val;
+}
+
+// Transposes a 64x64 bit matrix in place, row i being rows[i] read from its
+// most significant bit. An involution, so it also slices and unslices.
+inline void transposeBits64(uint64_t* rows) {
+    uint64_t mask = 0x00000000FFFFFFFFull;
+    for (int width = 32; width != 0; width >>= 1, mask ^= mask << width) {
+        for (int k = 0; k < 64; k = ((k | width) + 1) & ~width) {
+            uint64_t t = (rows[k] ^ (rows[k | width] >> width)) & mask;
+            rows[k] ^= t;
+            rows[k | width] ^= t << width;
+        }
+    }
 }
\ No newline at end of file
@@ -3,6 +3,10 @@
 #include <algorithm>
 #include <random>
 #include<memory>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <stdexcept>
 enum class Pudding {
     Zeros,
     ANSIX923,
@@ -10,55 +14,80 @@ enum class Pudding {
     ISO10126
 };
 
+// Paddings only ever touch the last block, so the primitives work on that alone
+// and the body of the message can go to the mode straight from the caller's buffer.
 class IPadding {
 public:
-    virtual std::vector<uint8_t>  makePadding(std::vector<uint8_t>& block, int size) = 0;
+    // tail holds the used (< size) message bytes that follow the last whole block
+    // and has room for size bytes; pads it in place and returns its new length,
+    // either 0 or size.
+    virtual size_t padTail(uint8_t* tail, size_t used, size_t size) = 0;
+
+    // last is the final block of the decrypted data, length bytes (the block
+    // length, or 0 when there is no data); how many bytes to drop from the end.
+    // Throws invalid_argument when it does not hold a valid padding.
+    virtual size_t paddingLength(const uint8_t* last, size_t length) = 0;
+
+    std::vector<uint8_t> makePadding(std::vector<uint8_t>& block, int size) {
+        size_t body = block.size() - block.size() % size;
+        std::vector<uint8_t> result(body + size);
+        std::copy(block.begin(), block.end(), result.begin());
+        result.resize(body + padTail(result.data() + body, block.size() - body, size));
+        return result;
+    }
+
+    std::vector<uint8_t> undoPadding(std::vector<uint8_t>& block, int size) {
+        size_t last = std::min(block.size(), static_cast<size_t>(size));
+        return std::vector<uint8_t>(block.begin(), block.end() - paddingLength(block.data() + block.size() - last, last));
+    }
 
-    virtual std::vector<uint8_t>  undoPadding(std::vector<uint8_t>& block) = 0;
     virtual ~IPadding() = default;
 };
 
+// The last byte of the block is the padding length, from 1 to the block length.
+inline uint8_t checkedPaddingSize(const uint8_t* last, size_t length) {
+    if (length == 0 || last[length - 1] == 0 || last[length - 1] > length) {
+        throw std::invalid_argument("Invalid padding");
+    }
+    return last[length - 1];
+}
+
 class ANSIX923Padding : public IPadding {
 public:
     ANSIX923Padding() = default;
-    std::vector<uint8_t>  makePadding(std::vector<uint8_t>& block, int size) {
-        size_t n = block.size();
-        int lengthPadding = (n % size == 0) ? 0 : size - (n % size);
-        if (!lengthPadding)
-            return block;
-        std::vector<uint8_t> result(n + lengthPadding);
-        std::copy(block.begin(), block.begin() + n, result.begin());
-        result[n + lengthPadding - 1] = static_cast<uint8_t>(lengthPadding);
-        return result;
+    // a whole block of padding when the message is aligned, otherwise it cannot be told from data
+    size_t padTail(uint8_t* tail, size_t used, size_t size) {
+        std::fill(tail + used, tail + size - 1, 0);
+        tail[size - 1] = static_cast<uint8_t>(size - used);
+        return size;
     }
 
-
-    std::vector<uint8_t>  undoPadding(std::vector<uint8_t>& block) {
-        uint8_t padding_size = block.back();
-        std::vector<uint8_t> result(block.begin(), block.end() - padding_size);
-        return result;
+    size_t paddingLength(const uint8_t* last, size_t length) {
+        size_t n = checkedPaddingSize(last, length);
+        for (size_t i = length - n; i < length - 1; ++i) {
+            if (last[i] != 0)
+                throw std::invalid_argument("Invalid padding");
+        }
+        return n;
     }
 
 };
 class ZerozPadding : public IPadding {
 public:
     ZerozPadding() = default;
-    std::vector<uint8_t>  makePadding(std::vector<uint8_t>& block, int size) {
-        size_t n = block.size();
-        int lengthPadding = (n % size == 0) ? 0 : size - (n % size);
-        if (!lengthPadding)
-            return block;
-        std::vector<uint8_t> result(n + lengthPadding);
-        std::copy(block.begin(), block.begin() + n, result.begin());
-        return result;
+    size_t padTail(uint8_t* tail, size_t used, size_t size) {
+        if (!used)
+            return 0;
+        std::fill(tail + used, tail + size, 0);
+        return size;
     }
 
-    std::vector<uint8_t>  undoPadding(std::vector<uint8_t>& block) {
-        size_t i = block.size() - 1;
-        while (block[i] == 0) {
-            i--;
+    size_t paddingLength(const uint8_t* last, size_t length) {
+        size_t n = length;
+        while (n > 0 && last[n - 1] == 0) {
+            n--;
         }
-        return std::vector<uint8_t>(block.begin(), block.begin() + i + 1);
+        return length - n;
     }
 
 };
@@ -66,20 +95,18 @@ public:
 class PKCS7Padding : public IPadding {
 public:
     PKCS7Padding() = default;
-    std::vector<uint8_t>  makePadding(std::vector<uint8_t>& block, int size) {
-        size_t n = block.size();
-        int lengthPadding = (n % size == 0) ? 0 : size - (n % size);
-        if (!lengthPadding)
-            return block;
-        std::vector<uint8_t> result(n + lengthPadding);
-        std::copy(block.begin(), block.begin() + n, result.begin());
-        std::fill(result.begin() + n, result.end(), static_cast<uint8_t>(lengthPadding));
-        return result;
+    size_t padTail(uint8_t* tail, size_t used, size_t size) {
+        std::fill(tail + used, tail + size, static_cast<uint8_t>(size - used));
+        return size;
     }
 
-    std::vector<uint8_t>  undoPadding(std::vector<uint8_t>& block) {
-        uint8_t padding_size = block.back();
-        return std::vector<uint8_t>(block.begin(), block.end() - padding_size);
+    size_t paddingLength(const uint8_t* last, size_t length) {
+        size_t n = checkedPaddingSize(last, length);
+        for (size_t i = length - n; i < length; ++i) {
+            if (last[i] != n)
+                throw std::invalid_argument("Invalid padding");
+        }
+        return n;
     }
 
 };
@@ -87,37 +114,29 @@ public:
 class ISO10126Padding : public IPadding {
 public:
     ISO10126Padding() = default;
-    std::vector<uint8_t> makePadding(std::vector<uint8_t>& block, int size) {
+    size_t padTail(uint8_t* tail, size_t used, size_t size) {
         static bool seeded = false;
         if (!seeded) {
             std::srand(static_cast<unsigned>(std::time(nullptr)));
             seeded = true;
         }
-        size_t n = block.size();
-        int lengthPadding = (n % size == 0) ? 0 : size - (n % size);
-        if (!lengthPadding)
-            return block;
-        std::vector<uint8_t> result(n + lengthPadding);
 
-        std::copy(block.begin(), block.end(), result.begin());
-
-        for (size_t i = n; i < result.size() - 1; ++i) {
-            result[i] = static_cast<uint8_t>(std::rand() % 256);
+        for (size_t i = used; i < size - 1; ++i) {
+            tail[i] = static_cast<uint8_t>(std::rand() % 256);
         }
 
-        result.back() = static_cast<uint8_t>(lengthPadding);
+        tail[size - 1] = static_cast<uint8_t>(size - used);
 
-        return result;
+        return size;
     }
 
-    std::vector<uint8_t>  undoPadding(std::vector<uint8_t>& block) {
-        uint8_t padding_size = block.back();
-        return std::vector<uint8_t>(block.begin(), block.end() - padding_size);
+    size_t paddingLength(const uint8_t* last, size_t length) {
+        return checkedPaddingSize(last, length);
     }
 
 };
 
-std::unique_ptr<IPadding> getPadding(Pudding pudding) {
+inline std::unique_ptr<IPadding> getPadding(Pudding pudding) {
     switch (pudding) {
     case(Pudding::Zeros):
         return  std::make_unique<ZerozPadding>();
@@ -136,7 +155,7 @@ std::unique_ptr<IPadding> getPadding(Pudding pudding) {
         break;
 
     default:
-        throw std::exception("Padding doesnt exist");
+        throw std::invalid_argument("Padding doesnt exist");
     }
 
 }
\ No newline at end of file
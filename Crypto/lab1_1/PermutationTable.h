@@ -0,0 +1,107 @@
+#pragma once
+#include <vector>
+#include <memory_resource>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+// Compiled form of a pBlock: for every input byte position and every byte value
+// the output bits it sets, so applying the permutation is one lookup and OR per
+// input byte. Produces exactly what permuteBits produces for the same arguments.
+// Tables are small, build them once (e.g. as a function-local static) and share.
+class PermutationTable {
+private:
+    static constexpr size_t MAX_OUTPUT_LENGTH = 16;
+
+    size_t inputLength = 0;
+    size_t outputLength;
+    // [inputLength][256][2]: output bits 0..63 and 64..127, most significant first
+    std::vector<uint64_t> table;
+
+    const uint64_t* entry(size_t byteIndex, uint8_t value) const {
+        return table.data() + (byteIndex * 256 + value) * 2;
+    }
+
+    template<class Bytes>
+    Bytes applyVector(const Bytes& data) const {
+        if (data.size() < inputLength) {
+            throw std::invalid_argument("Data is shorter than permutation input");
+        }
+        Bytes result(outputLength, 0, data.get_allocator());
+        apply(data.data(), result.data());
+        return result;
+    }
+
+public:
+    explicit PermutationTable(const std::vector<uint16_t>& pBlock, bool reverseBitOrder = false, bool isOneIndexed = true)
+        : outputLength((pBlock.size() + 7) / 8) {
+        if (outputLength > MAX_OUTPUT_LENGTH) {
+            throw std::invalid_argument("Permutation output is longer than 128 bits");
+        }
+        for (auto index : pBlock) {
+            if (isOneIndexed && index == 0) {
+                throw std::invalid_argument("Permutation entry 0 in a one-indexed pBlock");
+            }
+            size_t position = index - (isOneIndexed ? 1 : 0);
+            inputLength = std::max(inputLength, position / 8 + 1);
+        }
+        table.assign(inputLength * 256 * 2, 0);
+
+        for (size_t dataBitIndex = 0; dataBitIndex < pBlock.size(); dataBitIndex++) {
+            size_t position = pBlock[dataBitIndex] - (isOneIndexed ? 1 : 0);
+            int bitOffset = reverseBitOrder ? position % 8 : 7 - position % 8;
+            uint64_t bit = uint64_t(1) << (63 - dataBitIndex % 64);
+
+            for (int value = 0; value < 256; value++) {
+                if (value & (1 << bitOffset)) {
+                    table[((position / 8) * 256 + value) * 2 + dataBitIndex / 64] |= bit;
+                }
+            }
+        }
+    }
+
+    size_t getInputLength() const {
+        return inputLength;
+    }
+
+    size_t getOutputLength() const {
+        return outputLength;
+    }
+
+    // Reads getInputLength() bytes from in, writes getOutputLength() bytes to out.
+    // in and out may be the same buffer.
+    void apply(const uint8_t* in, uint8_t* out) const {
+        uint64_t high = 0, low = 0;
+        for (size_t i = 0; i < inputLength; i++) {
+            const uint64_t* bits = entry(i, in[i]);
+            high |= bits[0];
+            low |= bits[1];
+        }
+        for (size_t i = 0; i < outputLength; i++) {
+            uint64_t word = i < 8 ? high : low;
+            out[i] = static_cast<uint8_t>(word >> (56 - 8 * (i % 8)));
+        }
+    }
+
+    std::vector<uint8_t> apply(const std::vector<uint8_t>& data) const {
+        return applyVector(data);
+    }
+
+    // Result lives on the same memory resource as data.
+    std::pmr::vector<uint8_t> apply(const std::pmr::vector<uint8_t>& data) const {
+        return applyVector(data);
+    }
+
+    // Block held big-endian in a uint64_t, as bytesToUint64 reads it; only for
+    // permutations of at most 64 bits in and out. The result is left-aligned.
+    uint64_t apply(uint64_t block) const {
+        if (inputLength > 8 || outputLength > 8) {
+            throw std::logic_error("Permutation is wider than 64 bits");
+        }
+        uint64_t result = 0;
+        for (size_t i = 0; i < inputLength; i++) {
+            result |= entry(i, static_cast<uint8_t>(block >> (56 - 8 * i)))[0];
+        }
+        return result;
+    }
+};
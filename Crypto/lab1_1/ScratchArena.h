@@ -0,0 +1,158 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <memory_resource>
+#include <atomic>
+#include <algorithm>
+
+struct ScratchArenaStats {
+    size_t peakBytes = 0;       // most any one thread had in use at once
+    size_t reservedBytes = 0;   // most any one thread keeps in chunks
+};
+
+// Per-thread bump allocator for the temporaries of one block or one message.
+// Nothing is freed allocation by allocation: a ScratchScope rewinds the arena to
+// where it stood when the scope was opened, and the chunks stay with the thread
+// for the next message. Containers on the arena must be destroyed before the
+// scope that was open when they allocated.
+class ScratchArena : public std::pmr::memory_resource {
+public:
+    struct Mark {
+        size_t chunk;
+        size_t offset;
+        size_t used;
+    };
+
+private:
+    static constexpr size_t CHUNK_SIZE = 16 * 1024;
+
+    struct Chunk {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+
+    std::vector<Chunk> chunks;
+    size_t current = 0;
+    size_t offset = 0;
+    size_t used = 0;
+    size_t peak = 0;
+    size_t reserved = 0;
+    size_t published = 0;
+
+    static std::atomic<size_t>& globalPeak() {
+        static std::atomic<size_t> value{ 0 };
+        return value;
+    }
+
+    static std::atomic<size_t>& globalReserved() {
+        static std::atomic<size_t> value{ 0 };
+        return value;
+    }
+
+    static void raise(std::atomic<size_t>& value, size_t candidate) {
+        size_t seen = value.load(std::memory_order_relaxed);
+        while (seen < candidate && !value.compare_exchange_weak(seen, candidate, std::memory_order_relaxed)) {
+        }
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        for (;;) {
+            if (current < chunks.size()) {
+                Chunk& chunk = chunks[current];
+                uintptr_t base = reinterpret_cast<uintptr_t>(chunk.data.get());
+                size_t start = ((base + offset + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base;
+                if (start + bytes <= chunk.size) {
+                    used += start + bytes - offset;
+                    offset = start + bytes;
+                    peak = std::max(peak, used);
+                    return chunk.data.get() + start;
+                }
+                // the rest of this chunk counts as used, so a rewind restores used exactly
+                used += chunk.size - offset;
+                ++current;
+                offset = 0;
+                continue;
+            }
+            size_t size = std::max(CHUNK_SIZE, bytes + alignment);
+            chunks.push_back({ std::unique_ptr<uint8_t[]>(new uint8_t[size]), size });
+            reserved += size;
+        }
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    ScratchArena() = default;
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    static ScratchArena& local() {
+        thread_local ScratchArena arena;
+        return arena;
+    }
+
+    Mark getMark() const {
+        return { current, offset, used };
+    }
+
+    void rewind(const Mark& mark) {
+        current = mark.chunk;
+        offset = mark.offset;
+        used = mark.used;
+        if (peak > published) {
+            published = peak;
+            raise(globalPeak(), peak);
+            raise(globalReserved(), reserved);
+        }
+    }
+
+    size_t getUsed() const {
+        return used;
+    }
+
+    size_t getPeak() const {
+        return peak;
+    }
+
+    static ScratchArenaStats globalStats() {
+        ScratchArenaStats stats;
+        stats.peakBytes = globalPeak().load(std::memory_order_relaxed);
+        stats.reservedBytes = globalReserved().load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+class ScratchScope {
+private:
+    ScratchArena& arena;
+    ScratchArena::Mark mark;
+
+public:
+    ScratchScope() : arena(ScratchArena::local()), mark(arena.getMark()) {
+    }
+
+    ScratchScope(const ScratchScope&) = delete;
+    ScratchScope& operator=(const ScratchScope&) = delete;
+
+    ~ScratchScope() {
+        arena.rewind(mark);
+    }
+
+    std::pmr::memory_resource* resource() const {
+        return &arena;
+    }
+};
+
+using ScratchBytes = std::pmr::vector<uint8_t>;
+
+// Peaks over every thread since start, published whenever a scope closes.
+inline ScratchArenaStats scratchArenaStats() {
+    return ScratchArena::globalStats();
+}
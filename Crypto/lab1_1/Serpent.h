@@ -3,22 +3,38 @@
 #include "Operations.h"
 #include "CryptoInterfaces.h"
 #include "SerpentConfig.h"
+#include "PermutationTable.h"
 #include "memory"
 
+inline const PermutationTable& serpentInitialPermutation() {
+	static const PermutationTable table(IP_TABLE, false, false);
+	return table;
+}
+
+inline const PermutationTable& serpentFinalPermutation() {
+	static const PermutationTable table(FP_TABLE, false, false);
+	return table;
+}
+
+// Expanded Serpent key: 33 round keys of four words, round r at words[4 * r].
+struct alignas(64) SerpentKeySchedule {
+	uint32_t words[132];
+};
+
 class SerpentKeyExpansion : public IExpandKey {
 private:
 	int32_t PHI = 0x9E3779B9;
 	std::vector<int16_t> S_BOX_ORDER = { 3, 2, 1, 0, 7, 6, 5, 4 };
 public:
 
-	std::vector<std::vector<uint8_t>> expand(const std::vector<uint8_t>& key) override {
-		std::vector<uint8_t> keyNew(32);
-		std::copy(key.begin(), key.end(), keyNew.begin());
+	void expand(const std::vector<uint8_t>& key, SerpentKeySchedule& schedule) {
+		uint8_t keyNew[32] = {};
+		std::copy(key.begin(), key.end(), keyNew);
 		if (key.size() < 32) {
 			keyNew[key.size()] = 0x80;
 		}
 
-		std::vector<uint32_t> w(132);
+		uint32_t* w = schedule.words;
 
 		for (int i = 0; i < 8; ++i) {
 			w[i] = static_cast<uint32_t>(keyNew[4 * i]) |
@@ -42,6 +58,12 @@ public:
 				w[block * 4 + i] = applySBox(w[block * 4 + i], sBoxIndex);
 			}
 		}
+	}
+
+	std::vector<std::vector<uint8_t>> expand(const std::vector<uint8_t>& key) override {
+		SerpentKeySchedule schedule;
+		expand(key, schedule);
+		const uint32_t* w = schedule.words;
 
 		std::vector<std::vector<uint8_t>> roundKeys(33, std::vector<uint8_t>(16));
 
@@ -63,11 +85,17 @@ public:
 
 class Serpent : public ICrypt {
 private:
-	std::vector<std::vector<uint8_t>> rKeys;
-	std::unique_ptr<IExpandKey> expandKey;
+	SerpentKeySchedule schedule;
+	std::unique_ptr<SerpentKeyExpansion> expandKey;
 
 protected:
-	void applySboxes(std::vector<uint8_t>& block, int round, bool invSbox) {
+	void addRoundKey(uint8_t* block, int round) {
+		for (int i = 0; i < 4; ++i) {
+			uint32ToBytes(toUInt32(block + 4 * i) ^ schedule.words[4 * round + i], block + 4 * i);
+		}
+	}
+
+	void applySboxes(uint8_t* block, int round, bool invSbox) {
 		int sBoxIndex = round % 8;
 
 		for (int group = 0; group < 32; ++group) {
@@ -82,35 +110,12 @@ protected:
 			block[byteIndex] = (block[byteIndex] & ~(0x0F << pos)) | (substituted << pos);
 		}
 	}
-	std::vector<uint8_t> intToBytes(uint32_t value) {
-		std::vector<uint8_t> result(4);
-		result[0] = static_cast<uint8_t>(value);
-		result[1] = static_cast<uint8_t>(value >> 8);
-		result[2] = static_cast<uint8_t>(value >> 16);
-		result[3] = static_cast<uint8_t>(value >> 24);
-		return result;
-	}
-
-	std::vector<uint8_t> getBytes(uint32_t x0, uint32_t x1, uint32_t x2, uint32_t x3) {
-		std::vector<uint8_t> result(16);
-		auto b0 = intToBytes(x0);
-		auto b1 = intToBytes(x1);
-		auto b2 = intToBytes(x2);
-		auto b3 = intToBytes(x3);
 
-		std::copy(b0.begin(), b0.end(), result.begin());
-		std::copy(b1.begin(), b1.end(), result.begin() + 4);
-		std::copy(b2.begin(), b2.end(), result.begin() + 8);
-		std::copy(b3.begin(), b3.end(), result.begin() + 12);
-
-		return result;
-	}
-
-	std::vector<uint8_t> linearTransformation(const std::vector<uint8_t>& block) {
-		uint32_t x0 = toUInt32(block, 0);
-		uint32_t x1 = toUInt32(block, 4);
-		uint32_t x2 = toUInt32(block, 8);
-		uint32_t x3 = toUInt32(block, 12);
+	void linearTransformation(uint8_t* block) {
+		uint32_t x0 = toUInt32(block);
+		uint32_t x1 = toUInt32(block + 4);
+		uint32_t x2 = toUInt32(block + 8);
+		uint32_t x3 = toUInt32(block + 12);
 
 		x0 = LeftRotate(x0, 13);
 		x2 = LeftRotate(x2, 3);
@@ -123,14 +128,17 @@ protected:
 		x0 = LeftRotate(x0, 5);
 		x2 = LeftRotate(x2, 22);
 
-		return getBytes(x0, x1, x2, x3);
+		uint32ToBytes(x0, block);
+		uint32ToBytes(x1, block + 4);
+		uint32ToBytes(x2, block + 8);
+		uint32ToBytes(x3, block + 12);
 	}
 
-	std::vector<uint8_t> inverseLinearTransformation(const std::vector<uint8_t>& block) {
-		uint32_t x0 = toUInt32(block, 0);
-		uint32_t x1 = toUInt32(block, 4);
-		uint32_t x2 = toUInt32(block, 8);
-		uint32_t x3 = toUInt32(block, 12);
+	void inverseLinearTransformation(uint8_t* block) {
+		uint32_t x0 = toUInt32(block);
+		uint32_t x1 = toUInt32(block + 4);
+		uint32_t x2 = toUInt32(block + 8);
+		uint32_t x3 = toUInt32(block + 12);
 
 		x2 = RightRotate(x2, 22);
 		x0 = RightRotate(x0, 5);
@@ -143,7 +151,10 @@ protected:
 		x2 = RightRotate(x2, 3);
 		x0 = RightRotate(x0, 13);
 
-		return getBytes(x0, x1, x2, x3);
+		uint32ToBytes(x0, block);
+		uint32ToBytes(x1, block + 4);
+		uint32ToBytes(x2, block + 8);
+		uint32ToBytes(x3, block + 12);
 	}
 
 public:
@@ -157,48 +168,53 @@ public:
 
 	ICrypt* setKey(std::vector<uint8_t>& key) override
 	{
-		rKeys = expandKey->expand(key);
+		expandKey->expand(key, schedule);
 		return this;
 	}
 
-	std::vector<uint8_t> encrypt(const std::vector<uint8_t>& data) override {
-
-		std::vector<uint8_t> block = permuteBits(data, IP_TABLE);
+	void encryptBlock(const uint8_t* in, uint8_t* out) override {
+		uint8_t block[16];
+		serpentInitialPermutation().apply(in, block);
 
 		for (int round = 0; round < 32; round++) {
-			block = xorBits(block, rKeys[round]);
+			addRoundKey(block, round);
 			applySboxes(block, round, false);
 			if (round != 32 - 1) {
-				block = linearTransformation(block);
+				linearTransformation(block);
 			}
 		}
 
-		block = xorBits(block, rKeys[32]);
-		block = permuteBits(block, FP_TABLE);
-
-		return block;
+		addRoundKey(block, 32);
+		serpentFinalPermutation().apply(block, out);
 	}
 
-	std::vector<uint8_t> decrypt(const std::vector<uint8_t>& ciphertext) override {
-		if (ciphertext.size() != 16) {
-			throw std::invalid_argument("Block length must be 16 bytes");
-		}
-
-		std::vector<uint8_t> block = permuteBits(ciphertext, IP_TABLE);
+	void decryptBlock(const uint8_t* in, uint8_t* out) override {
+		uint8_t block[16];
+		serpentInitialPermutation().apply(in, block);
 
-		block = xorBits(block, rKeys[32]);
+		addRoundKey(block, 32);
 
 		for (int round = 31; round >= 0; --round) {
 			if (round != 31) {
-				block = inverseLinearTransformation(block);
+				inverseLinearTransformation(block);
 			}
 			applySboxes(block, round, true);
-			block = xorBits(block, rKeys[round]);
+			addRoundKey(block, round);
 		}
 
-		block = permuteBits(block, FP_TABLE);
+		serpentFinalPermutation().apply(block, out);
+	}
+
+	void encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override {
+		for (size_t i = 0; i < n; ++i) {
+			Serpent::encryptBlock(in + i * 16, out + i * 16);
+		}
+	}
 
-		return block;
+	void decryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override {
+		for (size_t i = 0; i < n; ++i) {
+			Serpent::decryptBlock(in + i * 16, out + i * 16);
+		}
 	}
 
 		
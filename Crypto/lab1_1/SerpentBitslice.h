@@ -0,0 +1,874 @@
+#pragma once
+
+#include "Operations.h"
+#include "CryptoInterfaces.h"
+#include "Serpent.h"
+#include "SerpentSimd.h"
+#include <memory>
+
+// Word-level Serpent engine. Produces the same ciphertexts as Serpent, but keeps
+// the block in four 32-bit words between IP and FP. Each S-box layer transposes
+// the 4x4 bit matrix held in every nibble column, so bit b of all 32 nibbles
+// lands in word b, runs a gate circuit for S_BOX[i] on the four words and
+// transposes back. Everything is templated on the word type W, so the same
+// rounds can run on wider registers holding several blocks. Batches of 64
+// blocks and more go through the fully sliced kernel further down instead, which
+// needs no transposes inside the rounds; this engine takes single blocks and tails.
+
+// S_BOX[i] as gate circuits taken from the algebraic normal form of the table;
+// x0 carries the least significant bit of every nibble.
+template<class W>
+inline void serpentSbox0(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t012 = t12 & x0;
+	W t023 = t03 & x2;
+	W t123 = t13 & x2;
+	W y0 = ~(x0 ^ x2 ^ x3 ^ t01 ^ t02 ^ t12 ^ t012 ^ t023 ^ t123);
+	W y1 = ~(x0 ^ t02 ^ t12 ^ t13 ^ t012 ^ t023 ^ t123);
+	W y2 = x1 ^ x3 ^ t01 ^ t02 ^ t13 ^ t012 ^ t123;
+	W y3 = x0 ^ x1 ^ x2 ^ x3 ^ t03;
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentSbox1(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t013 = t13 & x0;
+	W t023 = t23 & x0;
+	W t123 = t23 & x1;
+	W y0 = ~(x0 ^ x1 ^ t12 ^ t03 ^ t23 ^ t023 ^ t123);
+	W y1 = ~(x0 ^ x2 ^ x3 ^ t01 ^ t02 ^ t13 ^ t013 ^ t023 ^ t123);
+	W y2 = ~(x1 ^ x2 ^ x3 ^ t01);
+	W y3 = ~(x1 ^ x3 ^ t02 ^ t03 ^ t013 ^ t023 ^ t123);
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentSbox2(W& x0, W& x1, W& x2, W& x3) {
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t012 = t12 & x0;
+	W t013 = t13 & x0;
+	W t023 = t23 & x0;
+	W y0 = x1 ^ x2 ^ x3 ^ t02;
+	W y1 = x0 ^ x1 ^ x2 ^ t12 ^ t03 ^ t23 ^ t012 ^ t013 ^ t023;
+	W y2 = x0 ^ x1 ^ x3 ^ t12 ^ t13 ^ t23 ^ t013 ^ t023;
+	W y3 = ~(x0 ^ x1 ^ x2 ^ t13 ^ t012);
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentSbox3(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t012 = t12 & x0;
+	W t013 = t13 & x0;
+	W t023 = t23 & x0;
+	W t123 = t23 & x1;
+	W y0 = x0 ^ x1 ^ x3 ^ t12 ^ t03 ^ t23 ^ t023 ^ t123;
+	W y1 = x0 ^ x1 ^ t02 ^ t03 ^ t23 ^ t013 ^ t023;
+	W y2 = x0 ^ x2 ^ x3 ^ t01 ^ t13 ^ t012 ^ t013;
+	W y3 = x0 ^ x1 ^ x2 ^ x3 ^ t01 ^ t02 ^ t23 ^ t012 ^ t023;
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentSbox4(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t012 = t12 & x0;
+	W t013 = t13 & x0;
+	W t023 = t23 & x0;
+	W t123 = t23 & x1;
+	W y0 = ~(x1 ^ x2 ^ x3 ^ t01 ^ t03 ^ t13);
+	W y1 = x0 ^ x3 ^ t02 ^ t12 ^ t13 ^ t23 ^ t023 ^ t123;
+	W y2 = x0 ^ x2 ^ t01 ^ t12 ^ t13 ^ t23 ^ t012 ^ t013 ^ t123;
+	W y3 = x0 ^ x1 ^ x2 ^ t12 ^ t03 ^ t13 ^ t013;
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentSbox5(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t012 = t02 & x1;
+	W t013 = t13 & x0;
+	W t023 = t23 & x0;
+	W t123 = t23 & x1;
+	W y0 = ~(x1 ^ x2 ^ x3 ^ t01 ^ t03 ^ t13);
+	W y1 = ~(x0 ^ x2 ^ x3 ^ t01 ^ t13 ^ t23 ^ t013);
+	W y2 = ~(x1 ^ x3 ^ t02 ^ t23 ^ t013 ^ t023 ^ t123);
+	W y3 = ~(x0 ^ x1 ^ x2 ^ x3 ^ t03 ^ t012 ^ t023);
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentSbox6(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t012 = t12 & x0;
+	W t013 = t13 & x0;
+	W t123 = t23 & x1;
+	W y0 = ~(x0 ^ x1 ^ x2 ^ x3 ^ t02 ^ t12 ^ t012 ^ t013 ^ t123);
+	W y1 = ~(x1 ^ x2 ^ t03);
+	W y2 = ~(x0 ^ x2 ^ t01 ^ t12 ^ t13 ^ t23 ^ t012 ^ t013 ^ t123);
+	W y3 = x1 ^ x2 ^ x3 ^ t01 ^ t02 ^ t23 ^ t012 ^ t123;
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentSbox7(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t012 = t12 & x0;
+	W t013 = t13 & x0;
+	W t023 = t23 & x0;
+	W t123 = t23 & x1;
+	W y0 = ~(x2 ^ t01 ^ t03 ^ t13 ^ t23 ^ t023 ^ t123);
+	W y1 = x1 ^ x2 ^ x3 ^ t01 ^ t02 ^ t12 ^ t03 ^ t013 ^ t023;
+	W y2 = x0 ^ x1 ^ x2 ^ x3 ^ t03 ^ t13 ^ t012 ^ t013 ^ t123;
+	W y3 = x0 ^ x1 ^ x2 ^ t02 ^ t03 ^ t012;
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentInvSbox0(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t013 = t13 & x0;
+	W t023 = t23 & x0;
+	W t123 = t23 & x1;
+	W y0 = ~(x2 ^ t01 ^ t12 ^ t03 ^ t13 ^ t23 ^ t013 ^ t023 ^ t123);
+	W y1 = x0 ^ x1 ^ x2 ^ t02 ^ t13 ^ t023 ^ t123;
+	W y2 = ~(x0 ^ x1 ^ x2 ^ x3 ^ t01);
+	W y3 = ~(x0 ^ x3 ^ t12 ^ t23 ^ t013 ^ t023 ^ t123);
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentInvSbox1(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t012 = t12 & x0;
+	W t023 = t03 & x2;
+	W t123 = t13 & x2;
+	W y0 = ~(x0 ^ x1 ^ t01 ^ t13 ^ t012 ^ t023 ^ t123);
+	W y1 = x1 ^ x2 ^ x3 ^ t03 ^ t13 ^ t012 ^ t023 ^ t123;
+	W y2 = ~(x0 ^ x1 ^ x3 ^ t02 ^ t12 ^ t012 ^ t023);
+	W y3 = x0 ^ x2 ^ x3 ^ t13;
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentInvSbox2(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t012 = t12 & x0;
+	W t013 = t13 & x0;
+	W t023 = t23 & x0;
+	W y0 = x0 ^ x1 ^ x2 ^ t12 ^ t13;
+	W y1 = x1 ^ x2 ^ t01 ^ t03 ^ t23 ^ t013 ^ t023;
+	W y2 = ~(x0 ^ x2 ^ x3 ^ t01 ^ t03 ^ t13 ^ t013 ^ t023);
+	W y3 = ~(x3 ^ t01 ^ t12 ^ t012 ^ t023);
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentInvSbox3(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t012 = t12 & x0;
+	W t013 = t13 & x0;
+	W t023 = t23 & x0;
+	W t123 = t23 & x1;
+	W y0 = x0 ^ x2 ^ x3 ^ t12 ^ t03 ^ t13 ^ t123;
+	W y1 = x1 ^ x2 ^ x3 ^ t12 ^ t03 ^ t012 ^ t023 ^ t123;
+	W y2 = t01 ^ t02 ^ t12 ^ t03 ^ t13 ^ t23 ^ t013 ^ t023;
+	W y3 = x0 ^ x1 ^ x2 ^ t02 ^ t03 ^ t23 ^ t012 ^ t013;
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentInvSbox4(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t012 = t02 & x1;
+	W t013 = t13 & x0;
+	W t023 = t23 & x0;
+	W y0 = ~(x0 ^ x1 ^ x2 ^ x3 ^ t03 ^ t23 ^ t013 ^ t023);
+	W y1 = x2 ^ x3 ^ t01 ^ t02 ^ t03 ^ t023;
+	W y2 = ~(x0 ^ x1 ^ x2 ^ x3 ^ t01 ^ t02 ^ t13 ^ t012 ^ t013);
+	W y3 = x1 ^ x2 ^ t01 ^ t03 ^ t23 ^ t013;
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentInvSbox5(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t012 = t12 & x0;
+	W t013 = t13 & x0;
+	W t023 = t03 & x2;
+	W y0 = x0 ^ x3 ^ t12 ^ t013;
+	W y1 = x0 ^ x1 ^ x3 ^ t02 ^ t12 ^ t03 ^ t012 ^ t013;
+	W y2 = x0 ^ x2 ^ t01 ^ t13 ^ t013 ^ t023;
+	W y3 = ~(x1 ^ x2 ^ t01 ^ t03 ^ t012);
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentInvSbox6(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t012 = t12 & x0;
+	W t013 = t13 & x0;
+	W t123 = t23 & x1;
+	W y0 = ~(x0 ^ x3 ^ t01 ^ t02 ^ t12 ^ t012 ^ t013 ^ t123);
+	W y1 = ~(x1 ^ x2 ^ x3 ^ t02);
+	W y2 = ~(x0 ^ x1 ^ t12 ^ t13 ^ t23 ^ t013 ^ t123);
+	W y3 = ~(x1 ^ x2 ^ x3 ^ t01 ^ t12 ^ t03 ^ t23 ^ t012 ^ t013 ^ t123);
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentInvSbox7(W& x0, W& x1, W& x2, W& x3) {
+	W t01 = x0 & x1;
+	W t02 = x0 & x2;
+	W t12 = x1 & x2;
+	W t03 = x0 & x3;
+	W t13 = x1 & x3;
+	W t23 = x2 & x3;
+	W t012 = t12 & x0;
+	W t013 = t13 & x0;
+	W t023 = t23 & x0;
+	W t123 = t23 & x1;
+	W y0 = ~(x0 ^ x1 ^ t12 ^ t13 ^ t23 ^ t013 ^ t123);
+	W y1 = ~(x0 ^ x2 ^ x3 ^ t12 ^ t03 ^ t13 ^ t023 ^ t123);
+	W y2 = x1 ^ x3 ^ t02 ^ t23 ^ t013 ^ t023;
+	W y3 = x2 ^ t01 ^ t03 ^ t13 ^ t012 ^ t013;
+	x0 = y0;
+	x1 = y1;
+	x2 = y2;
+	x3 = y3;
+}
+
+template<class W>
+inline void serpentSbox(int index, W& x0, W& x1, W& x2, W& x3) {
+	switch (index) {
+	case 0: serpentSbox0(x0, x1, x2, x3); break;
+	case 1: serpentSbox1(x0, x1, x2, x3); break;
+	case 2: serpentSbox2(x0, x1, x2, x3); break;
+	case 3: serpentSbox3(x0, x1, x2, x3); break;
+	case 4: serpentSbox4(x0, x1, x2, x3); break;
+	case 5: serpentSbox5(x0, x1, x2, x3); break;
+	case 6: serpentSbox6(x0, x1, x2, x3); break;
+	default: serpentSbox7(x0, x1, x2, x3); break;
+	}
+}
+
+template<class W>
+inline void serpentInvSbox(int index, W& x0, W& x1, W& x2, W& x3) {
+	switch (index) {
+	case 0: serpentInvSbox0(x0, x1, x2, x3); break;
+	case 1: serpentInvSbox1(x0, x1, x2, x3); break;
+	case 2: serpentInvSbox2(x0, x1, x2, x3); break;
+	case 3: serpentInvSbox3(x0, x1, x2, x3); break;
+	case 4: serpentInvSbox4(x0, x1, x2, x3); break;
+	case 5: serpentInvSbox5(x0, x1, x2, x3); break;
+	case 6: serpentInvSbox6(x0, x1, x2, x3); break;
+	default: serpentInvSbox7(x0, x1, x2, x3); break;
+	}
+}
+
+// Transposes the 4x4 bit matrix in every nibble column: bit b of nibble n of
+// word w swaps places with bit w of nibble n of word b. It is its own inverse.
+template<class W>
+inline void serpentNibbleTranspose(W& x0, W& x1, W& x2, W& x3) {
+	W t = ((x0 >> 2) ^ x2) & W(0x33333333u);
+	x2 = x2 ^ t;
+	x0 = x0 ^ (t << 2);
+	t = ((x1 >> 2) ^ x3) & W(0x33333333u);
+	x3 = x3 ^ t;
+	x1 = x1 ^ (t << 2);
+	t = ((x0 >> 1) ^ x1) & W(0x55555555u);
+	x1 = x1 ^ t;
+	x0 = x0 ^ (t << 1);
+	t = ((x2 >> 1) ^ x3) & W(0x55555555u);
+	x3 = x3 ^ t;
+	x2 = x2 ^ (t << 1);
+}
+
+template<class W>
+inline W serpentRotl(W x, int shift) {
+	return (x << shift) | (x >> (32 - shift));
+}
+
+template<class W>
+inline void serpentLinearTransformation(W& x0, W& x1, W& x2, W& x3) {
+	x0 = serpentRotl(x0, 13);
+	x2 = serpentRotl(x2, 3);
+	x1 = x1 ^ x0 ^ x2;
+	x3 = x3 ^ x2 ^ (x0 << 3);
+	x1 = serpentRotl(x1, 1);
+	x3 = serpentRotl(x3, 7);
+	x0 = x0 ^ x1 ^ x3;
+	x2 = x2 ^ x3 ^ (x1 << 7);
+	x0 = serpentRotl(x0, 5);
+	x2 = serpentRotl(x2, 22);
+}
+
+template<class W>
+inline void serpentInverseLinearTransformation(W& x0, W& x1, W& x2, W& x3) {
+	x2 = serpentRotl(x2, 32 - 22);
+	x0 = serpentRotl(x0, 32 - 5);
+	x2 = x2 ^ x3 ^ (x1 << 7);
+	x0 = x0 ^ x1 ^ x3;
+	x3 = serpentRotl(x3, 32 - 7);
+	x1 = serpentRotl(x1, 32 - 1);
+	x3 = x3 ^ x2 ^ (x0 << 3);
+	x1 = x1 ^ x0 ^ x2;
+	x2 = serpentRotl(x2, 32 - 3);
+	x0 = serpentRotl(x0, 32 - 13);
+}
+
+template<class W>
+inline void serpentAddRoundKey(W& x0, W& x1, W& x2, W& x3, const uint32_t* key) {
+	x0 = x0 ^ W(key[0]);
+	x1 = x1 ^ W(key[1]);
+	x2 = x2 ^ W(key[2]);
+	x3 = x3 ^ W(key[3]);
+}
+
+template<int Index, class W>
+inline void serpentRound(W& x0, W& x1, W& x2, W& x3, const uint32_t* key, bool last) {
+	serpentAddRoundKey(x0, x1, x2, x3, key);
+	serpentNibbleTranspose(x0, x1, x2, x3);
+	serpentSbox(Index, x0, x1, x2, x3);
+	serpentNibbleTranspose(x0, x1, x2, x3);
+	if (!last) {
+		serpentLinearTransformation(x0, x1, x2, x3);
+	}
+}
+
+template<int Index, class W>
+inline void serpentInverseRound(W& x0, W& x1, W& x2, W& x3, const uint32_t* key, bool first) {
+	if (!first) {
+		serpentInverseLinearTransformation(x0, x1, x2, x3);
+	}
+	serpentNibbleTranspose(x0, x1, x2, x3);
+	serpentInvSbox(Index, x0, x1, x2, x3);
+	serpentNibbleTranspose(x0, x1, x2, x3);
+	serpentAddRoundKey(x0, x1, x2, x3, key);
+}
+
+// The 32 rounds plus the final key, between IP and FP. Unrolled by eight so
+// every S-box index is a compile-time constant.
+template<class W>
+inline void serpentEncryptRounds(W& x0, W& x1, W& x2, W& x3, const uint32_t* subkeys) {
+	for (int round = 0; round < 32; round += 8) {
+		serpentRound<0>(x0, x1, x2, x3, subkeys + 4 * round, false);
+		serpentRound<1>(x0, x1, x2, x3, subkeys + 4 * (round + 1), false);
+		serpentRound<2>(x0, x1, x2, x3, subkeys + 4 * (round + 2), false);
+		serpentRound<3>(x0, x1, x2, x3, subkeys + 4 * (round + 3), false);
+		serpentRound<4>(x0, x1, x2, x3, subkeys + 4 * (round + 4), false);
+		serpentRound<5>(x0, x1, x2, x3, subkeys + 4 * (round + 5), false);
+		serpentRound<6>(x0, x1, x2, x3, subkeys + 4 * (round + 6), false);
+		serpentRound<7>(x0, x1, x2, x3, subkeys + 4 * (round + 7), round + 7 == 31);
+	}
+	serpentAddRoundKey(x0, x1, x2, x3, subkeys + 4 * 32);
+}
+
+template<class W>
+inline void serpentDecryptRounds(W& x0, W& x1, W& x2, W& x3, const uint32_t* subkeys) {
+	serpentAddRoundKey(x0, x1, x2, x3, subkeys + 4 * 32);
+	for (int round = 31; round >= 0; round -= 8) {
+		serpentInverseRound<7>(x0, x1, x2, x3, subkeys + 4 * round, round == 31);
+		serpentInverseRound<6>(x0, x1, x2, x3, subkeys + 4 * (round - 1), false);
+		serpentInverseRound<5>(x0, x1, x2, x3, subkeys + 4 * (round - 2), false);
+		serpentInverseRound<4>(x0, x1, x2, x3, subkeys + 4 * (round - 3), false);
+		serpentInverseRound<3>(x0, x1, x2, x3, subkeys + 4 * (round - 4), false);
+		serpentInverseRound<2>(x0, x1, x2, x3, subkeys + 4 * (round - 5), false);
+		serpentInverseRound<1>(x0, x1, x2, x3, subkeys + 4 * (round - 6), false);
+		serpentInverseRound<0>(x0, x1, x2, x3, subkeys + 4 * (round - 7), false);
+	}
+}
+
+// W::LANES blocks at once on a word type from SerpentSimd.h. IP and FP stay per
+// block, the rounds run across lanes. in and out may be the same buffer.
+template<class W>
+inline void serpentProcessLanes(const uint8_t* in, uint8_t* out, const uint32_t* subkeys, bool decrypt) {
+	uint32_t words[4][W::LANES];
+	uint8_t block[16];
+
+	for (int lane = 0; lane < W::LANES; ++lane) {
+		serpentInitialPermutation().apply(in + 16 * lane, block);
+		for (int w = 0; w < 4; ++w) {
+			words[w][lane] = toUInt32(block + 4 * w);
+		}
+	}
+
+	W x0 = W::load(words[0]);
+	W x1 = W::load(words[1]);
+	W x2 = W::load(words[2]);
+	W x3 = W::load(words[3]);
+	if (decrypt) {
+		serpentDecryptRounds(x0, x1, x2, x3, subkeys);
+	}
+	else {
+		serpentEncryptRounds(x0, x1, x2, x3, subkeys);
+	}
+	x0.store(words[0]);
+	x1.store(words[1]);
+	x2.store(words[2]);
+	x3.store(words[3]);
+
+	for (int lane = 0; lane < W::LANES; ++lane) {
+		for (int w = 0; w < 4; ++w) {
+			uint32ToBytes(words[w][lane], block + 4 * w);
+		}
+		serpentFinalPermutation().apply(block, out + 16 * lane);
+	}
+}
+
+// Fully sliced Serpent for 64 blocks per 64 bits of W: one word per bit of the
+// four 32-bit words, one block per bit lane. Slicing is a bit transpose on entry
+// and exit, IP and FP only decide which slice goes to which word, and all 32
+// rounds stay sliced: the S-boxes are the same circuits on four words and the
+// linear transformation is plain XORs, its rotations just renaming words.
+
+// Block bits as permuteBits numbers them (bit 0 = most significant bit of byte
+// 0) for every word bit: ip[32 * w + p] feeds bit p of word w after IP, output
+// bit j is FP's read of word bit fp[j].
+struct SerpentBitsliceIndex {
+	uint8_t ip[128];
+	uint8_t fp[128];
+
+	SerpentBitsliceIndex() {
+		for (int w = 0; w < 4; ++w) {
+			for (int p = 0; p < 32; ++p) {
+				ip[32 * w + p] = static_cast<uint8_t>(IP_TABLE[8 * (4 * w + p / 8) + 7 - p % 8]);
+			}
+		}
+		for (int j = 0; j < 128; ++j) {
+			int bit = FP_TABLE[j];
+			fp[j] = static_cast<uint8_t>(32 * (bit / 32) + 8 * (bit / 8 % 4) + 7 - bit % 8);
+		}
+	}
+
+	static const SerpentBitsliceIndex& get() {
+		static const SerpentBitsliceIndex index;
+		return index;
+	}
+};
+
+// Bit p of word w of every block is x[w][(p + offset[w]) & 31], so rotating a
+// word only moves its offset.
+template<class W>
+struct SerpentSlices {
+	W x[4][32];
+	int offset[4] = {};
+
+	W& at(int w, int p) {
+		return x[w][(p + offset[w]) & 31];
+	}
+
+	void rotateLeft(int w, int shift) {
+		offset[w] = (offset[w] - shift) & 31;
+	}
+};
+
+template<class W>
+inline void serpentSlicedAddRoundKey(SerpentSlices<W>& s, const uint32_t* key) {
+	for (int w = 0; w < 4; ++w) {
+		// bit i of k belongs to x[w][i]
+		uint32_t k = s.offset[w] == 0 ? key[w] : LeftRotate(key[w], s.offset[w]);
+		for (int i = 0; i < 32; ++i) {
+			s.x[w][i] = s.x[w][i] ^ sliceMask<W>((k >> i) & 1);
+		}
+	}
+}
+
+template<int Index, bool Inverse, class W>
+inline void serpentSlicedSboxes(SerpentSlices<W>& s) {
+	for (int w = 0; w < 4; ++w) {
+		for (int p = 0; p < 32; p += 4) {
+			if (Inverse) {
+				serpentInvSbox(Index, s.at(w, p), s.at(w, p + 1), s.at(w, p + 2), s.at(w, p + 3));
+			}
+			else {
+				serpentSbox(Index, s.at(w, p), s.at(w, p + 1), s.at(w, p + 2), s.at(w, p + 3));
+			}
+		}
+	}
+}
+
+template<class W>
+inline void serpentSlicedLinearTransformation(SerpentSlices<W>& s) {
+	s.rotateLeft(0, 13);
+	s.rotateLeft(2, 3);
+	for (int p = 0; p < 32; ++p) {
+		s.at(1, p) = s.at(1, p) ^ s.at(0, p) ^ s.at(2, p);
+		s.at(3, p) = s.at(3, p) ^ s.at(2, p);
+		if (p >= 3) {
+			s.at(3, p) = s.at(3, p) ^ s.at(0, p - 3);
+		}
+	}
+	s.rotateLeft(1, 1);
+	s.rotateLeft(3, 7);
+	for (int p = 0; p < 32; ++p) {
+		s.at(0, p) = s.at(0, p) ^ s.at(1, p) ^ s.at(3, p);
+		s.at(2, p) = s.at(2, p) ^ s.at(3, p);
+		if (p >= 7) {
+			s.at(2, p) = s.at(2, p) ^ s.at(1, p - 7);
+		}
+	}
+	s.rotateLeft(0, 5);
+	s.rotateLeft(2, 22);
+}
+
+template<class W>
+inline void serpentSlicedInverseLinearTransformation(SerpentSlices<W>& s) {
+	s.rotateLeft(2, 32 - 22);
+	s.rotateLeft(0, 32 - 5);
+	for (int p = 0; p < 32; ++p) {
+		s.at(0, p) = s.at(0, p) ^ s.at(1, p) ^ s.at(3, p);
+		s.at(2, p) = s.at(2, p) ^ s.at(3, p);
+		if (p >= 7) {
+			s.at(2, p) = s.at(2, p) ^ s.at(1, p - 7);
+		}
+	}
+	s.rotateLeft(3, 32 - 7);
+	s.rotateLeft(1, 32 - 1);
+	for (int p = 0; p < 32; ++p) {
+		s.at(1, p) = s.at(1, p) ^ s.at(0, p) ^ s.at(2, p);
+		s.at(3, p) = s.at(3, p) ^ s.at(2, p);
+		if (p >= 3) {
+			s.at(3, p) = s.at(3, p) ^ s.at(0, p - 3);
+		}
+	}
+	s.rotateLeft(2, 32 - 3);
+	s.rotateLeft(0, 32 - 13);
+}
+
+template<int Index, class W>
+inline void serpentSlicedRound(SerpentSlices<W>& s, const uint32_t* key, bool last) {
+	serpentSlicedAddRoundKey(s, key);
+	serpentSlicedSboxes<Index, false>(s);
+	if (!last) {
+		serpentSlicedLinearTransformation(s);
+	}
+}
+
+template<int Index, class W>
+inline void serpentSlicedInverseRound(SerpentSlices<W>& s, const uint32_t* key, bool first) {
+	if (!first) {
+		serpentSlicedInverseLinearTransformation(s);
+	}
+	serpentSlicedSboxes<Index, true>(s);
+	serpentSlicedAddRoundKey(s, key);
+}
+
+template<class W>
+inline void serpentSlicedEncryptRounds(SerpentSlices<W>& s, const uint32_t* subkeys) {
+	for (int round = 0; round < 32; round += 8) {
+		serpentSlicedRound<0>(s, subkeys + 4 * round, false);
+		serpentSlicedRound<1>(s, subkeys + 4 * (round + 1), false);
+		serpentSlicedRound<2>(s, subkeys + 4 * (round + 2), false);
+		serpentSlicedRound<3>(s, subkeys + 4 * (round + 3), false);
+		serpentSlicedRound<4>(s, subkeys + 4 * (round + 4), false);
+		serpentSlicedRound<5>(s, subkeys + 4 * (round + 5), false);
+		serpentSlicedRound<6>(s, subkeys + 4 * (round + 6), false);
+		serpentSlicedRound<7>(s, subkeys + 4 * (round + 7), round + 7 == 31);
+	}
+	serpentSlicedAddRoundKey(s, subkeys + 4 * 32);
+}
+
+template<class W>
+inline void serpentSlicedDecryptRounds(SerpentSlices<W>& s, const uint32_t* subkeys) {
+	serpentSlicedAddRoundKey(s, subkeys + 4 * 32);
+	for (int round = 31; round >= 0; round -= 8) {
+		serpentSlicedInverseRound<7>(s, subkeys + 4 * round, round == 31);
+		serpentSlicedInverseRound<6>(s, subkeys + 4 * (round - 1), false);
+		serpentSlicedInverseRound<5>(s, subkeys + 4 * (round - 2), false);
+		serpentSlicedInverseRound<4>(s, subkeys + 4 * (round - 3), false);
+		serpentSlicedInverseRound<3>(s, subkeys + 4 * (round - 4), false);
+		serpentSlicedInverseRound<2>(s, subkeys + 4 * (round - 5), false);
+		serpentSlicedInverseRound<1>(s, subkeys + 4 * (round - 6), false);
+		serpentSlicedInverseRound<0>(s, subkeys + 4 * (round - 7), false);
+	}
+}
+
+// 8 * sizeof(W) consecutive blocks from in to out, W being uint64_t or a word
+// from SerpentSimd.h; in and out may be the same buffer.
+template<class W>
+inline void serpentBitsliceBlocks(const uint8_t* in, uint8_t* out, const uint32_t* subkeys, bool decrypt) {
+	constexpr int GROUPS = sizeof(W) / 8;
+	const SerpentBitsliceIndex& index = SerpentBitsliceIndex::get();
+	// 64 blocks per group; once transposed, rows[128 * g + k] is bit k of them
+	uint64_t rows[128 * GROUPS];
+	SerpentSlices<W> s;
+
+	for (int g = 0; g < GROUPS; ++g) {
+		uint64_t* group = rows + 128 * g;
+		for (int i = 0; i < 64; ++i) {
+			group[i] = bytesToUint64(in + 16 * (64 * g + i));
+			group[64 + i] = bytesToUint64(in + 16 * (64 * g + i) + 8);
+		}
+		transposeBits64(group);
+		transposeBits64(group + 64);
+	}
+
+	for (int w = 0; w < 4; ++w) {
+		for (int p = 0; p < 32; ++p) {
+			s.x[w][p] = gatherSlice<W>(rows + index.ip[32 * w + p], 128);
+		}
+	}
+	if (decrypt) {
+		serpentSlicedDecryptRounds(s, subkeys);
+	}
+	else {
+		serpentSlicedEncryptRounds(s, subkeys);
+	}
+	for (int j = 0; j < 128; ++j) {
+		scatterSlice(s.at(index.fp[j] / 32, index.fp[j] % 32), rows + j, 128);
+	}
+
+	for (int g = 0; g < GROUPS; ++g) {
+		uint64_t* group = rows + 128 * g;
+		transposeBits64(group);
+		transposeBits64(group + 64);
+		for (int i = 0; i < 64; ++i) {
+			uint64ToBytes(group[i], out + 16 * (64 * g + i));
+			uint64ToBytes(group[64 + i], out + 16 * (64 * g + i) + 8);
+		}
+	}
+}
+
+#if defined(SERPENT_SIMD_AVX2)
+// The AVX2 instantiations, compiled for AVX2 whatever flags the unit has.
+SERPENT_AVX2_KERNEL inline void serpentProcessLanesAvx2(const uint8_t* in, uint8_t* out, const uint32_t* subkeys, bool decrypt) {
+	serpentProcessLanes<SerpentAvx2Word>(in, out, subkeys, decrypt);
+}
+
+SERPENT_AVX2_KERNEL inline void serpentBitsliceBlocksAvx2(const uint8_t* in, uint8_t* out, const uint32_t* subkeys, bool decrypt) {
+	serpentBitsliceBlocks<SerpentAvx2Word>(in, out, subkeys, decrypt);
+}
+#endif
+
+class SerpentBitslice : public ICrypt {
+private:
+	SerpentKeySchedule schedule;
+	std::unique_ptr<SerpentKeyExpansion> expandKey;
+	SerpentSimdLevel simdLevel = serpentSimdLevel();
+
+	static void loadWords(const uint8_t* in, uint32_t* words) {
+		for (int w = 0; w < 4; ++w) {
+			words[w] = toUInt32(in + 4 * w);
+		}
+	}
+
+	static void storeWords(const uint32_t* words, uint8_t* out) {
+		for (int w = 0; w < 4; ++w) {
+			uint32ToBytes(words[w], out + 4 * w);
+		}
+	}
+
+public:
+	SerpentBitslice() {
+		expandKey = std::make_unique<SerpentKeyExpansion>();
+	}
+
+	int getBlockLength() override {
+		return 16;
+	}
+
+	ICrypt* setKey(std::vector<uint8_t>& key) override
+	{
+		expandKey->expand(key, schedule);
+		return this;
+	}
+
+	void encryptBlock(const uint8_t* in, uint8_t* out) override {
+		uint32_t x[4];
+		uint8_t block[16];
+		serpentInitialPermutation().apply(in, block);
+		loadWords(block, x);
+		serpentEncryptRounds(x[0], x[1], x[2], x[3], schedule.words);
+		storeWords(x, block);
+		serpentFinalPermutation().apply(block, out);
+	}
+
+	void decryptBlock(const uint8_t* in, uint8_t* out) override {
+		uint32_t x[4];
+		uint8_t block[16];
+		serpentInitialPermutation().apply(in, block);
+		loadWords(block, x);
+		serpentDecryptRounds(x[0], x[1], x[2], x[3], schedule.words);
+		storeWords(x, block);
+		serpentFinalPermutation().apply(block, out);
+	}
+
+	void encryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override {
+		processBlocks(in, out, n, false);
+	}
+
+	void decryptBlocks(const uint8_t* in, uint8_t* out, size_t n) override {
+		processBlocks(in, out, n, true);
+	}
+
+	// Caps the kernel used by the batch calls, e.g. to compare the SSE2 and the
+	// scalar path on an AVX2 machine. Levels the CPU lacks are never selected.
+	SerpentBitslice* setSimdLevel(SerpentSimdLevel level) {
+		simdLevel = std::min(level, serpentSimdLevel());
+		return this;
+	}
+
+	SerpentSimdLevel getSimdLevel() const {
+		return simdLevel;
+	}
+
+private:
+	void processBlocks(const uint8_t* in, uint8_t* out, size_t n, bool decrypt) {
+		size_t i = 0;
+#if defined(SERPENT_SIMD_AVX2)
+		if (simdLevel == SerpentSimdLevel::Avx2) {
+			for (; i + 256 <= n; i += 256) {
+				serpentBitsliceBlocksAvx2(in + i * 16, out + i * 16, schedule.words, decrypt);
+			}
+		}
+#endif
+#if defined(SERPENT_SIMD_SSE2)
+		if (simdLevel != SerpentSimdLevel::None) {
+			for (; i + 128 <= n; i += 128) {
+				serpentBitsliceBlocks<SerpentSse2Word>(in + i * 16, out + i * 16, schedule.words, decrypt);
+			}
+		}
+#endif
+		for (; i + 64 <= n; i += 64) {
+			serpentBitsliceBlocks<uint64_t>(in + i * 16, out + i * 16, schedule.words, decrypt);
+		}
+		// shorter tails: the word engine, several blocks per SIMD word
+#if defined(SERPENT_SIMD_AVX2)
+		if (simdLevel == SerpentSimdLevel::Avx2) {
+			for (; i + 8 <= n; i += 8) {
+				serpentProcessLanesAvx2(in + i * 16, out + i * 16, schedule.words, decrypt);
+			}
+		}
+#endif
+#if defined(SERPENT_SIMD_SSE2)
+		if (simdLevel != SerpentSimdLevel::None) {
+			for (; i + 4 <= n; i += 4) {
+				serpentProcessLanes<SerpentSse2Word>(in + i * 16, out + i * 16, schedule.words, decrypt);
+			}
+		}
+#endif
+		for (; i < n; ++i) {
+			if (decrypt) {
+				SerpentBitslice::decryptBlock(in + i * 16, out + i * 16);
+			}
+			else {
+				SerpentBitslice::encryptBlock(in + i * 16, out + i * 16);
+			}
+		}
+	}
+};
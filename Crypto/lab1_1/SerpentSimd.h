@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// SIMD word types for the templated Serpent rounds in SerpentBitslice.h: one
+// 32-bit lane per block, so a __m128i word carries 4 blocks and a __m256i 8.
+// The fully sliced Serpent and DES kernels use them as plain bit vectors of 128
+// and 256 blocks.
+// SSE2 is part of x64. The AVX2 kernels are always built on x64, without global
+// flags: MSVC accepts AVX2 intrinsics anywhere, GCC and Clang only in functions
+// marked SERPENT_AVX2_TARGET. They are only used when CPUID and the OS report
+// support.
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SERPENT_SIMD_SSE2 1
+#include <emmintrin.h>
+#define SERPENT_SIMD_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define SERPENT_AVX2_TARGET
+#define SERPENT_AVX2_KERNEL
+#else
+#define SERPENT_AVX2_TARGET __attribute__((target("avx2")))
+// A kernel entry point: everything it calls is inlined into it and so compiled
+// for AVX2 as well, templates that know nothing about the target included.
+#define SERPENT_AVX2_KERNEL __attribute__((target("avx2"), flatten))
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+enum class SerpentSimdLevel {
+	None,
+	Sse2,
+	Avx2
+};
+
+#if defined(SERPENT_SIMD_SSE2)
+
+struct SerpentSse2Word {
+	static constexpr int LANES = 4;
+	__m128i v;
+
+	SerpentSse2Word() = default;
+	SerpentSse2Word(__m128i value) : v(value) {}
+	explicit SerpentSse2Word(uint32_t value) : v(_mm_set1_epi32(static_cast<int>(value))) {}
+
+	static SerpentSse2Word load(const uint32_t* words) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(words));
+	}
+
+	void store(uint32_t* words) const {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(words), v);
+	}
+
+	SerpentSse2Word operator&(SerpentSse2Word other) const { return _mm_and_si128(v, other.v); }
+	SerpentSse2Word operator|(SerpentSse2Word other) const { return _mm_or_si128(v, other.v); }
+	SerpentSse2Word operator^(SerpentSse2Word other) const { return _mm_xor_si128(v, other.v); }
+	SerpentSse2Word operator~() const { return _mm_xor_si128(v, _mm_set1_epi32(-1)); }
+	SerpentSse2Word operator<<(int shift) const { return _mm_slli_epi32(v, shift); }
+	SerpentSse2Word operator>>(int shift) const { return _mm_srli_epi32(v, shift); }
+
+	// Two 64-bit groups, groups[0] and groups[stride], for the fully sliced kernel.
+	static SerpentSse2Word gather(const uint64_t* groups, size_t stride) {
+		return _mm_set_epi64x(static_cast<long long>(groups[stride]), static_cast<long long>(groups[0]));
+	}
+
+	void scatter(uint64_t* groups, size_t stride) const {
+		alignas(16) uint64_t lanes[2];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+		groups[0] = lanes[0];
+		groups[stride] = lanes[1];
+	}
+};
+
+#endif
+
+#if defined(SERPENT_SIMD_AVX2)
+
+struct SerpentAvx2Word {
+	static constexpr int LANES = 8;
+	__m256i v;
+
+	SerpentAvx2Word() = default;
+	SERPENT_AVX2_TARGET SerpentAvx2Word(__m256i value) : v(value) {}
+	SERPENT_AVX2_TARGET explicit SerpentAvx2Word(uint32_t value) : v(_mm256_set1_epi32(static_cast<int>(value))) {}
+
+	SERPENT_AVX2_TARGET static SerpentAvx2Word load(const uint32_t* words) {
+		return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+	}
+
+	SERPENT_AVX2_TARGET void store(uint32_t* words) const {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(words), v);
+	}
+
+	SERPENT_AVX2_TARGET SerpentAvx2Word operator&(SerpentAvx2Word other) const { return _mm256_and_si256(v, other.v); }
+	SERPENT_AVX2_TARGET SerpentAvx2Word operator|(SerpentAvx2Word other) const { return _mm256_or_si256(v, other.v); }
+	SERPENT_AVX2_TARGET SerpentAvx2Word operator^(SerpentAvx2Word other) const { return _mm256_xor_si256(v, other.v); }
+	SERPENT_AVX2_TARGET SerpentAvx2Word operator~() const { return _mm256_xor_si256(v, _mm256_set1_epi32(-1)); }
+	SERPENT_AVX2_TARGET SerpentAvx2Word operator<<(int shift) const { return _mm256_slli_epi32(v, shift); }
+	SERPENT_AVX2_TARGET SerpentAvx2Word operator>>(int shift) const { return _mm256_srli_epi32(v, shift); }
+
+	SERPENT_AVX2_TARGET static SerpentAvx2Word gather(const uint64_t* groups, size_t stride) {
+		return _mm256_set_epi64x(static_cast<long long>(groups[3 * stride]), static_cast<long long>(groups[2 * stride]),
+			static_cast<long long>(groups[stride]), static_cast<long long>(groups[0]));
+	}
+
+	SERPENT_AVX2_TARGET void scatter(uint64_t* groups, size_t stride) const {
+		alignas(32) uint64_t lanes[4];
+		_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), v);
+		for (int i = 0; i < 4; ++i) {
+			groups[i * stride] = lanes[i];
+		}
+	}
+};
+
+#endif
+
+// For the fully sliced kernels of Serpent and DES, which take uint64_t or one of
+// the words above as a plain bit vector of 64 blocks per 64 bits.
+
+// All ones in every lane when bit is 1.
+template<class W>
+inline W sliceMask(uint32_t bit) {
+	return W(0u - bit);
+}
+
+template<>
+inline uint64_t sliceMask<uint64_t>(uint32_t bit) {
+	return 0 - static_cast<uint64_t>(bit);
+}
+
+// The 64-bit groups of one slice sit stride apart in the transposed rows.
+template<class W>
+inline W gatherSlice(const uint64_t* groups, size_t stride) {
+	return W::gather(groups, stride);
+}
+
+template<>
+inline uint64_t gatherSlice<uint64_t>(const uint64_t* groups, size_t) {
+	return groups[0];
+}
+
+template<class W>
+inline void scatterSlice(const W& word, uint64_t* groups, size_t stride) {
+	word.scatter(groups, stride);
+}
+
+inline void scatterSlice(uint64_t word, uint64_t* groups, size_t) {
+	groups[0] = word;
+}
+
+inline SerpentSimdLevel detectSerpentSimdLevel() {
+#if defined(SERPENT_SIMD_AVX2)
+	unsigned regs[4] = {};
+	unsigned maxLeaf;
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	maxLeaf = static_cast<unsigned>(info[0]);
+	if (maxLeaf >= 7) {
+		__cpuid(info, 1);
+		regs[2] = static_cast<unsigned>(info[2]);
+		__cpuidex(info, 7, 0);
+		regs[1] = static_cast<unsigned>(info[1]);
+	}
+#else
+	maxLeaf = __get_cpuid_max(0, nullptr);
+	if (maxLeaf >= 7) {
+		unsigned a, b, c, d;
+		__cpuid(1, a, b, c, d);
+		regs[2] = c;
+		__cpuid_count(7, 0, a, b, c, d);
+		regs[1] = b;
+	}
+#endif
+	bool osAvx = false;
+	// OSXSAVE and AVX, then XCR0 must show the OS saving XMM and YMM state
+	if ((regs[2] & (1u << 27)) && (regs[2] & (1u << 28))) {
+#if defined(_MSC_VER)
+		unsigned long long xcr0 = _xgetbv(0);
+#else
+		unsigned lo, hi;
+		__asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		unsigned long long xcr0 = (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+		osAvx = (xcr0 & 6) == 6;
+	}
+	if (osAvx && (regs[1] & (1u << 5))) {
+		return SerpentSimdLevel::Avx2;
+	}
+#endif
+#if defined(SERPENT_SIMD_SSE2)
+	return SerpentSimdLevel::Sse2;
+#else
+	return SerpentSimdLevel::None;
+#endif
+}
+
+inline SerpentSimdLevel serpentSimdLevel() {
+	static const SerpentSimdLevel level = detectSerpentSimdLevel();
+	return level;
+}
@@ -0,0 +1,209 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include "EncryptorManager.h"
+#include "KeyScheduleCache.h"
+
+struct SessionPoolStats {
+    uint64_t reused = 0;
+    uint64_t created = 0;
+    uint64_t dropped = 0;
+    size_t idle = 0;
+    size_t capacity = 0;
+};
+
+// Idle managers of a SessionPool. Sessions hold it by shared_ptr, so they may
+// outlive the pool itself.
+class IdleSessions {
+private:
+    struct Idle {
+        std::string id;
+        std::unique_ptr<EncryptorManager> manager;
+    };
+
+    mutable std::mutex mutex;
+    size_t capacity;
+    std::list<Idle> idle;   // most recently returned first
+    std::unordered_map<std::string, std::vector<std::list<Idle>::iterator>> index;
+    SessionPoolStats stats;
+
+    void unlink(std::list<Idle>::iterator entry) {
+        auto found = index.find(entry->id);
+        auto& slots = found->second;
+        slots.erase(std::find(slots.begin(), slots.end(), entry));
+        if (slots.empty()) {
+            index.erase(found);
+        }
+        idle.erase(entry);
+    }
+
+public:
+    explicit IdleSessions(size_t capacity) : capacity(capacity) {
+    }
+
+    void put(std::string id, std::unique_ptr<EncryptorManager> manager) {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_front({ std::move(id), std::move(manager) });
+        index[idle.front().id].push_back(idle.begin());
+        if (idle.size() > capacity) {
+            unlink(std::prev(idle.end()));
+            ++stats.dropped;
+        }
+    }
+
+    std::unique_ptr<EncryptorManager> take(const std::string& id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(id);
+        if (found == index.end()) {
+            ++stats.created;
+            return nullptr;
+        }
+        auto entry = found->second.back();
+        std::unique_ptr<EncryptorManager> manager = std::move(entry->manager);
+        unlink(entry);
+        ++stats.reused;
+        return manager;
+    }
+
+    SessionPoolStats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        SessionPoolStats result = stats;
+        result.idle = idle.size();
+        result.capacity = capacity;
+        return result;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.clear();
+        index.clear();
+    }
+};
+
+// A keyed cipher with its mode and padding, reused for message after message.
+// Every message brings its own IV, so the per-message cost is the cipher work
+// plus resetting the chain. Not for concurrent use; take one per thread.
+class CryptoSession {
+private:
+    friend class SessionPool;
+
+    std::unique_ptr<EncryptorManager> manager;
+    std::shared_ptr<IdleSessions> home;
+    std::string id;
+
+    CryptoSession(std::unique_ptr<EncryptorManager> manager, std::shared_ptr<IdleSessions> home, std::string id)
+        : manager(std::move(manager)), home(std::move(home)), id(std::move(id)) {
+    }
+
+    // nothing of this user's messages (IV, AAD, an open stream) goes on to the next
+    void giveBack() {
+        if (home && manager) {
+            manager->reset();
+            home->put(std::move(id), std::move(manager));
+        }
+    }
+
+public:
+    CryptoSession(std::shared_ptr<ICrypt> keyedCipher, CryptoMode mode, Pudding padd) {
+        std::vector<uint8_t> IV(keyedCipher->getBlockLength());
+        manager = std::make_unique<EncryptorManager>(std::move(keyedCipher), mode, padd, IV);
+    }
+
+    CryptoSession(CryptoSession&&) = default;
+
+    CryptoSession& operator=(CryptoSession&& other) {
+        if (this != &other) {
+            giveBack();
+            manager = std::move(other.manager);
+            home = std::move(other.home);
+            id = std::move(other.id);
+        }
+        return *this;
+    }
+
+    ~CryptoSession() {
+        giveBack();
+    }
+
+    std::vector<uint8_t> encrypt(const std::vector<uint8_t>& IV, std::vector<uint8_t>& data) {
+        return manager->setIV(IV).encrypt(data);
+    }
+
+    std::vector<uint8_t> decrypt(const std::vector<uint8_t>& IV, std::vector<uint8_t>& ciphertext) {
+        return manager->setIV(IV).decrypt(ciphertext);
+    }
+
+    // For the streaming calls, AAD and setParallel. Only setParallel survives a trip
+    // through the pool; everything else is reset as by EncryptorManager::reset().
+    EncryptorManager& getManager() {
+        return *manager;
+    }
+};
+
+// Hands out sessions per (algorithm, backend, key, mode, padding), building new
+// ones from KeyScheduleCache engines. A session returns to the pool when it is
+// destroyed; at most `capacity` wait idle, the least recently returned go first.
+class SessionPool {
+private:
+    std::shared_ptr<IdleSessions> idle;
+    std::shared_ptr<KeyScheduleCache> cache;
+
+    static std::string makeId(EncryptionAlgorithm algorithm, CipherBackend backend, const std::vector<uint8_t>& key,
+        CryptoMode mode, Pudding padd) {
+        std::string id;
+        id.reserve(key.size() + 4);
+        id.push_back(static_cast<char>(algorithm));
+        id.push_back(static_cast<char>(backend));
+        id.push_back(static_cast<char>(mode));
+        id.push_back(static_cast<char>(padd));
+        id.append(key.begin(), key.end());
+        return id;
+    }
+
+public:
+    explicit SessionPool(size_t capacity = 1024,
+        std::shared_ptr<KeyScheduleCache> cache = std::make_shared<KeyScheduleCache>())
+        : cache(std::move(cache)) {
+        if (capacity == 0) {
+            throw std::invalid_argument("Session pool capacity must be positive");
+        }
+        idle = std::make_shared<IdleSessions>(capacity);
+    }
+
+    SessionPool(const SessionPool&) = delete;
+    SessionPool& operator=(const SessionPool&) = delete;
+
+    // Pooled or new, the session starts as EncryptorManager::reset() leaves it:
+    // zero IV, or with GCM no nonce at all, no AAD, no stream open. Pass an IV to
+    // encrypt/decrypt or call setIV.
+    CryptoSession acquire(EncryptionAlgorithm algorithm, CipherBackend backend, std::vector<uint8_t>& key,
+        CryptoMode mode, Pudding padd) {
+        std::string id = makeId(algorithm, backend, key, mode, padd);
+        std::unique_ptr<EncryptorManager> manager = idle->take(id);
+        if (!manager) {
+            std::shared_ptr<ICrypt> cipher = cache->get(algorithm, backend, key);
+            std::vector<uint8_t> IV(cipher->getBlockLength());
+            manager = std::make_unique<EncryptorManager>(std::move(cipher), mode, padd, IV);
+            manager->reset();
+        }
+        return CryptoSession(std::move(manager), idle, std::move(id));
+    }
+
+    SessionPoolStats getStats() const {
+        return idle->getStats();
+    }
+
+    KeyScheduleCache& getKeyCache() {
+        return *cache;
+    }
+
+    void clear() {
+        idle->clear();
+    }
+};
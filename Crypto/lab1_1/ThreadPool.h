@@ -0,0 +1,129 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include "Instrumentation.h"
+
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    bool runPendingTask(std::unique_lock<std::mutex>& lock) {
+        if (tasks.empty()) {
+            return false;
+        }
+        auto task = std::move(tasks.front());
+        tasks.pop();
+        lock.unlock();
+        task();
+        lock.lock();
+        return true;
+    }
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) {
+                return;
+            }
+            runPendingTask(lock);
+        }
+    }
+
+public:
+    explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency()) {
+        // the thread calling parallelFor works too, so it needs one helper less
+        unsigned helpers = threads > 1 ? threads - 1 : 0;
+        for (unsigned i = 0; i < helpers; ++i) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    unsigned size() const {
+        return static_cast<unsigned>(workers.size()) + 1;
+    }
+
+    // Splits [0, count) into at most size() contiguous chunks of at least minChunk
+    // items and calls body(first, chunkCount) for each of them. Blocks until every
+    // chunk is done and rethrows the first exception thrown by body.
+    template<class F>
+    void parallelFor(size_t count, size_t minChunk, F body) {
+        size_t chunks = std::min<size_t>(size(), count / std::max<size_t>(minChunk, 1));
+        if (chunks <= 1) {
+            if (count != 0) {
+                body(size_t(0), count);
+            }
+            return;
+        }
+
+        size_t chunkSize = (count + chunks - 1) / chunks;
+        size_t remaining = 0;
+        std::exception_ptr error;
+        std::condition_variable done;
+
+        auto runChunk = [&](size_t first) {
+            try {
+                body(first, std::min(chunkSize, count - first));
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t first = chunkSize; first < count; first += chunkSize) {
+                ++remaining;
+                tasks.push([&, first] {
+                    runChunk(first);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (--remaining == 0) {
+                        done.notify_all();
+                    }
+                });
+            }
+        }
+        condition.notify_all();
+
+        runChunk(0);
+
+        // help with queued chunks instead of idling, so nested calls cannot starve
+        std::unique_lock<std::mutex> lock(mutex);
+        while (remaining != 0) {
+            if (!runPendingTask(lock)) {
+                CRYPTO_IDLE();
+                done.wait(lock, [&] { return remaining == 0 || !tasks.empty(); });
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
@@ -0,0 +1,247 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include "EncryptorManager.h"
+
+constexpr size_t DEFAULT_SECTOR_SIZE = 4096;
+
+// XTS (IEEE 1619) for the 128-bit ciphers: every sector is encrypted on its own
+// under a tweak derived from its number, so any sector can be rewritten without
+// touching the others. The key is two keys of the algorithm back to back, K1 for
+// the data and K2 for the tweaks. A sector that is not a multiple of 16 bytes
+// (at least 16) ends with ciphertext stealing and keeps its length.
+//
+// The keyed engines are only read, so one XTSEncryptor can serve sectors from any
+// number of threads at once; in and out may be the same buffer.
+class XTSEncryptor {
+private:
+    static constexpr size_t GROUP_BLOCKS = 64;
+
+    std::shared_ptr<ICrypt> dataCipher;
+    std::shared_ptr<ICrypt> tweakCipher;
+    size_t sectorSize;
+    std::shared_ptr<ThreadPool> pool;
+    size_t minChunkSectors = 1;
+
+    // t *= x in GF(2^128), bytes in little-endian order
+    static void multiplyAlpha(uint8_t* t) {
+        uint8_t carry = t[15] >> 7;
+        for (int i = 15; i > 0; --i) {
+            t[i] = static_cast<uint8_t>((t[i] << 1) | (t[i - 1] >> 7));
+        }
+        t[0] = static_cast<uint8_t>((t[0] << 1) ^ (carry ? 0x87 : 0));
+    }
+
+    // Whole blocks: out = E(in ^ T) ^ T, the tweaks of a group computed ahead so
+    // the group goes through the engine's batch path in one call.
+    void processBlocks(const uint8_t* in, uint8_t* out, size_t blocksCount, uint8_t* tweak, bool decrypt) const {
+        uint8_t tweaks[GROUP_BLOCKS * 16];
+        for (size_t done = 0; done < blocksCount; done += GROUP_BLOCKS) {
+            size_t count = std::min(GROUP_BLOCKS, blocksCount - done);
+            for (size_t i = 0; i < count; ++i) {
+                std::copy(tweak, tweak + 16, tweaks + 16 * i);
+                multiplyAlpha(tweak);
+            }
+            const uint8_t* source = in + 16 * done;
+            uint8_t* target = out + 16 * done;
+            xorBits(source, tweaks, target, count * 16);
+            {
+                CRYPTO_STAGE(CryptoStage::Cipher, count * 16, count);
+                if (decrypt)
+                    dataCipher->decryptBlocks(target, target, count);
+                else
+                    dataCipher->encryptBlocks(target, target, count);
+            }
+            xorBits(target, tweaks, target, count * 16);
+        }
+    }
+
+    void processBlock(const uint8_t* in, uint8_t* out, const uint8_t* tweak, bool decrypt) const {
+        uint8_t block[16];
+        xorBits(in, tweak, block, 16);
+        CRYPTO_STAGE(CryptoStage::Cipher, 16, 1);
+        if (decrypt)
+            dataCipher->decryptBlock(block, block);
+        else
+            dataCipher->encryptBlock(block, block);
+        xorBits(block, tweak, out, 16);
+    }
+
+    // tweak = E_K2(sector number), already computed
+    void processSector(const uint8_t* in, uint8_t* out, size_t length, uint8_t* tweak, bool decrypt) const {
+        size_t whole = length / 16;
+        size_t partial = length % 16;
+        if (partial == 0) {
+            processBlocks(in, out, whole, tweak, decrypt);
+            return;
+        }
+
+        // the last whole block and the partial one swap tweaks when decrypting
+        processBlocks(in, out, whole - 1, tweak, decrypt);
+        size_t last = 16 * (whole - 1);
+        uint8_t nextTweak[16];
+        std::copy(tweak, tweak + 16, nextTweak);
+        multiplyAlpha(nextTweak);
+        const uint8_t* firstTweak = decrypt ? nextTweak : tweak;
+        const uint8_t* secondTweak = decrypt ? tweak : nextTweak;
+
+        uint8_t stolen[16];
+        processBlock(in + last, stolen, firstTweak, decrypt);
+        uint8_t block[16];
+        std::copy(in + last + 16, in + length, block);
+        std::copy(stolen + partial, stolen + 16, block + partial);
+        std::copy(stolen, stolen + partial, out + last + 16);
+        processBlock(block, out + last, secondTweak, decrypt);
+    }
+
+    void checkSectorLength(size_t length) const {
+        if (length < 16) {
+            throw std::invalid_argument("XTS sector must be at least one block long");
+        }
+    }
+
+    // Consecutive sectors from firstSector; the tweaks of a group of sectors are
+    // encrypted in one batch call.
+    void processSectors(uint64_t firstSector, const uint8_t* in, uint8_t* out, size_t length, bool decrypt) const {
+        size_t sectorsCount = (length + sectorSize - 1) / sectorSize;
+        checkSectorLength(length - (sectorsCount - 1) * sectorSize);
+
+        auto body = [&](size_t first, size_t count) {
+            uint8_t tweaks[GROUP_BLOCKS * 16];
+            for (size_t done = 0; done < count; done += GROUP_BLOCKS) {
+                size_t group = std::min(GROUP_BLOCKS, count - done);
+                makeTweakSeeds(firstSector + first + done, tweaks, group);
+                {
+                    CRYPTO_STAGE(CryptoStage::Cipher, group * 16, group);
+                    tweakCipher->encryptBlocks(tweaks, tweaks, group);
+                }
+                for (size_t i = 0; i < group; ++i) {
+                    size_t offset = (first + done + i) * sectorSize;
+                    processSector(in + offset, out + offset, std::min(sectorSize, length - offset),
+                        tweaks + 16 * i, decrypt);
+                }
+            }
+        };
+        if (pool == nullptr) {
+            body(size_t(0), sectorsCount);
+        }
+        else {
+            pool->parallelFor(sectorsCount, minChunkSectors, body);
+        }
+    }
+
+    // sector numbers as 16-byte little-endian values
+    static void makeTweakSeeds(uint64_t sector, uint8_t* seeds, size_t count) {
+        std::fill(seeds, seeds + 16 * count, 0);
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t number = sector + i;
+            for (int j = 0; j < 8; ++j) {
+                seeds[16 * i + j] = static_cast<uint8_t>(number >> (8 * j));
+            }
+        }
+    }
+
+    void check() const {
+        if (dataCipher->getBlockLength() != 16 || tweakCipher->getBlockLength() != 16) {
+            throw std::invalid_argument("XTS needs a 128-bit block cipher");
+        }
+        if (sectorSize < 16) {
+            throw std::invalid_argument("XTS sector must be at least one block long");
+        }
+    }
+
+public:
+    // key is K1 || K2, two keys of the algorithm of equal length
+    XTSEncryptor(std::vector<uint8_t>& key,
+                EncryptionAlgorithm algorithm,
+                size_t sectorLength = DEFAULT_SECTOR_SIZE,
+                CipherBackend backend = CipherBackend::Reference)
+        : sectorSize(sectorLength) {
+        if (key.size() % 2 != 0) {
+            throw std::invalid_argument("XTS key must be two keys of equal length");
+        }
+        std::vector<uint8_t> dataKey(key.begin(), key.begin() + key.size() / 2);
+        std::vector<uint8_t> tweakKey(key.begin() + key.size() / 2, key.end());
+        if (dataKey == tweakKey) {
+            throw std::invalid_argument("XTS key halves must differ");
+        }
+        dataCipher.reset(makeCipher(algorithm, backend));
+        tweakCipher.reset(makeCipher(algorithm, backend));
+        {
+            CRYPTO_STAGE(CryptoStage::KeyExpansion, key.size(), 0);
+            dataCipher->setKey(dataKey);
+            tweakCipher->setKey(tweakKey);
+        }
+        check();
+    }
+
+    // Engines that are already keyed, e.g. from KeyScheduleCache.
+    XTSEncryptor(std::shared_ptr<ICrypt> keyedDataCipher,
+                std::shared_ptr<ICrypt> keyedTweakCipher,
+                size_t sectorLength = DEFAULT_SECTOR_SIZE)
+        : dataCipher(std::move(keyedDataCipher)), tweakCipher(std::move(keyedTweakCipher)), sectorSize(sectorLength) {
+        check();
+    }
+
+    // Spreads the sectors of encryptSectors/decryptSectors over threads;
+    // threads <= 1 restores the serial path. Output is byte-identical either way.
+    XTSEncryptor& setParallel(unsigned threads) {
+        return setParallel(threads > 1 ? std::make_shared<ThreadPool>(threads) : nullptr);
+    }
+
+    XTSEncryptor& setParallel(std::shared_ptr<ThreadPool> threadPool) {
+        pool = std::move(threadPool);
+        minChunkSectors = std::max<size_t>(1, DEFAULT_MIN_CHUNK_BLOCKS * 16 / sectorSize);
+        return *this;
+    }
+
+    size_t getSectorSize() const {
+        return sectorSize;
+    }
+
+    // One sector of length bytes (at least 16, usually getSectorSize()).
+    void encryptSector(uint64_t sector, const uint8_t* in, uint8_t* out, size_t length) const {
+        checkSectorLength(length);
+        uint8_t tweak[16];
+        makeTweakSeeds(sector, tweak, 1);
+        tweakCipher->encryptBlock(tweak, tweak);
+        processSector(in, out, length, tweak, false);
+    }
+
+    void decryptSector(uint64_t sector, const uint8_t* in, uint8_t* out, size_t length) const {
+        checkSectorLength(length);
+        uint8_t tweak[16];
+        makeTweakSeeds(sector, tweak, 1);
+        tweakCipher->encryptBlock(tweak, tweak);
+        processSector(in, out, length, tweak, true);
+    }
+
+    // length bytes as consecutive sectors from firstSector; only the last one may
+    // be shorter than getSectorSize(), and not shorter than 16.
+    void encryptSectors(uint64_t firstSector, const uint8_t* in, uint8_t* out, size_t length) const {
+        if (length != 0) {
+            processSectors(firstSector, in, out, length, false);
+        }
+    }
+
+    void decryptSectors(uint64_t firstSector, const uint8_t* in, uint8_t* out, size_t length) const {
+        if (length != 0) {
+            processSectors(firstSector, in, out, length, true);
+        }
+    }
+
+    std::vector<uint8_t> encryptSectors(uint64_t firstSector, const std::vector<uint8_t>& data) const {
+        std::vector<uint8_t> result(data.size());
+        encryptSectors(firstSector, data.data(), result.data(), data.size());
+        return result;
+    }
+
+    std::vector<uint8_t> decryptSectors(uint64_t firstSector, const std::vector<uint8_t>& data) const {
+        std::vector<uint8_t> result(data.size());
+        decryptSectors(firstSector, data.data(), result.data(), data.size());
+        return result;
+    }
+};
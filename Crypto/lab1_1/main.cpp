@@ -5,7 +5,7 @@
 #include "Paddings.h"
 #include "EncryptorManager.h"
 #include "Cryptmodes.h"
-#include "Mars.h"
+#include "MARS.h"
 namespace tests {
     /*std::vector<uint8_t> data{ 0b00000001 };
     std::vector<uint16_t> pBlock = { 7,6,5,4,3,2,1,0 };